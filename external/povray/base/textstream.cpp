@@ -218,6 +218,23 @@ bool ITextStream::get_bytes (void* v, int n)
 {
     ungetbuffer = EOF;
 
+    // Bulk data larger than the buffer is read straight from the stream
+    if (n > ITEXTSTREAM_BUFFER_SIZE)
+    {
+        unsigned long cnt = maxbufferoffset - bufferoffset;
+        if (n - cnt > filelength - curpos)
+            return false;
+
+        memcpy (v, buffer + bufferoffset, cnt);
+        bufferoffset = maxbufferoffset = 0;
+
+        stream->read ((char*) v + cnt, n - cnt);
+        if (! *stream)
+            return false;
+        curpos += n - cnt;
+        return true;
+    }
+
     if (bufferoffset + n > maxbufferoffset)
         if (! RefillBuffer() || n > maxbufferoffset)
             return false;
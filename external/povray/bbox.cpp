@@ -37,6 +37,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 #include "frame.h"
 #include "vector.h"
 #include "bbox.h"
@@ -49,6 +55,15 @@
 #include "lightgrp.h"
 #include "povmsend.h"
 
+#include <algorithm>
+
+/* @CoppeliaSim@ */
+#if defined(__linux)
+#include <unistd.h>
+#include <pthread.h>
+#define POV_THREADED_BOUNDING 1
+#endif
+
 BEGIN_POV_NAMESPACE
 
 /*****************************************************************************
@@ -61,12 +76,30 @@ const int BUNCHING_FACTOR = 4;
 
 const int INITIAL_PRIORITY_QUEUE_SIZE = 256;
 
+/* @CoppeliaSim@ */
+/* Smallest number of elements on each side of a split done by two threads. */
+
+const long THREADED_SPLIT_SIZE = 4096;
+
 
 
 /*****************************************************************************
 * Local typedefs
 ******************************************************************************/
 
+/* @CoppeliaSim@ */
+/* Part of the elements split by a thread of its own, leaves are kept apart. */
+
+typedef struct
+{
+  BBOX_TREE **Elements;
+  long First, Last;
+  int Workers;
+  BBOX_TREE *Root;
+  BBOX_TREE **Leaves;
+  long Number_Of_Leaves, Max_Leaves;
+} BBOX_SPLIT;
+
 
 
 /*****************************************************************************
@@ -78,11 +111,19 @@ static BBOX_TREE *create_bbox_node (int size);
 static int find_axis (BBOX_TREE **Finite, long first, long last);
 static void calc_bbox (BBOX *BBox, BBOX_TREE **Finite, long first, long last);
 static void build_area_table (BBOX_TREE **Finite, long a, long b, DBL *areas);
-static int sort_and_split (BBOX_TREE **Root, BBOX_TREE **&Finite, long *numOfFiniteObjects, long first, long last);
+static int sort_and_split (BBOX_TREE **Root, BBOX_TREE **&Finite, BBOX_TREE **&Leaves, long *numOfLeaves, long *maxLeaves, long first, long last, int Workers);
 
 static void priority_queue_insert (PRIORITY_QUEUE *Queue, DBL Depth, BBOX_TREE *Node);
 
-static int CDECL compboxes (const void *in_a, const void *in_b);
+static int compboxes (const void *in_a, const void *in_b, int Axis);
+static int CDECL compboxes_x (const void *in_a, const void *in_b); /* @CoppeliaSim@ */
+static int CDECL compboxes_y (const void *in_a, const void *in_b); /* @CoppeliaSim@ */
+static int CDECL compboxes_z (const void *in_a, const void *in_b); /* @CoppeliaSim@ */
+static void add_leaf (BBOX_TREE *Leaf, BBOX_TREE **&Leaves, long *numOfLeaves, long *maxLeaves); /* @CoppeliaSim@ */
+static void split_part (BBOX_SPLIT *Part); /* @CoppeliaSim@ */
+#ifdef POV_THREADED_BOUNDING
+static void *split_thread (void *Part); /* @CoppeliaSim@ */
+#endif
 
 
 /*****************************************************************************
@@ -96,14 +137,6 @@ long numberOfFiniteObjects, numberOfInfiniteObjects, numberOfLightSources; // GL
 * Local variables
 ******************************************************************************/
 
-/* Current axis to sort along. */
-
-static int Axis = 0; // GLOBAL VARIABLE
-
-/* Number of finite elements. */
-
-static long maxfinitecount = 0; // GLOBAL VARIABLE
-
 /* Priority queue used for frame level bouning box hierarchy. */
 
 static PRIORITY_QUEUE *Frame_Queue; // GLOBAL VARIABLE
@@ -509,6 +542,11 @@ void Recompute_Inverse_BBox(BBOX *bbox, TRANSFORM *trans)
 *     - a bounding box enclosing the element
 *     - a pointer to the structure representing the element (e.g an object)
 *
+*   @CoppeliaSim@
+*
+*   Up to Workers threads split large groups of elements, the tree is the
+*   same as the one built by a single thread.
+*
 * CHANGES
 *
 *   Feb 1995 : Creation. (Extracted from Build_Bounding_Slabs)
@@ -517,10 +555,10 @@ void Recompute_Inverse_BBox(BBOX *bbox, TRANSFORM *trans)
 *
 ******************************************************************************/
 
-void Build_BBox_Tree(BBOX_TREE **Root, long numOfFiniteObjects, BBOX_TREE **&Finite, long  numOfInfiniteObjects, BBOX_TREE  **Infinite)
+void Build_BBox_Tree(BBOX_TREE **Root, long numOfFiniteObjects, BBOX_TREE **&Finite, long  numOfInfiniteObjects, BBOX_TREE  **Infinite, int Workers)
 {
   short i;
-  long low, high;
+  long low, high, maxfinitecount;
   BBOX_TREE *cd, *root;
 
   /*
@@ -540,7 +578,7 @@ void Build_BBox_Tree(BBOX_TREE **Root, long numOfFiniteObjects, BBOX_TREE **&Fin
     low = 0;
     high = numOfFiniteObjects;
 
-    while (sort_and_split(Root, Finite, &numOfFiniteObjects, low, high) == 0)
+    while (sort_and_split(Root, Finite, Finite, &numOfFiniteObjects, &maxfinitecount, low, high, Workers) == 0)
     {
       low = high;
       high = numOfFiniteObjects;
@@ -642,7 +680,8 @@ void Build_BBox_Tree(BBOX_TREE **Root, long numOfFiniteObjects, BBOX_TREE **&Fin
 
 void Build_Bounding_Slabs(BBOX_TREE **Root)
 {
-  long i, iFinite, iInfinite;
+  long i, iFinite, iInfinite, maxfinitecount;
+  int workers;
   BBOX_TREE **Finite, **Infinite;
   OBJECT *Object, *Temp;
 
@@ -771,7 +810,19 @@ void Build_Bounding_Slabs(BBOX_TREE **Root)
    * Now build the bounding box tree.
    */
 
-  Build_BBox_Tree(Root, numberOfFiniteObjects, Finite, numberOfInfiniteObjects, Infinite);
+  /* @CoppeliaSim@ */
+  workers = 1;
+
+#ifdef POV_THREADED_BOUNDING
+  workers = opts.Render_Workers;
+
+  if (workers <= 0)
+  {
+    workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+#endif
+
+  Build_BBox_Tree(Root, numberOfFiniteObjects, Finite, numberOfInfiniteObjects, Infinite, workers);
 
   /* Get rid of the Finite and Infinite arrays and just use Root. */
 
@@ -1460,6 +1511,7 @@ static BBOX_TREE *create_bbox_node(int size)
 * INPUT
 *
 *   in_a, in_b - Elements to compare
+*   Axis       - Axis to compare along
 *
 * OUTPUT
 *
@@ -1479,9 +1531,12 @@ static BBOX_TREE *create_bbox_node(int size)
 *
 *   Sep 1994 : Removed test for infinite objects because it's obsolete. [DB]
 *
+*   @CoppeliaSim@ The axis is passed instead of being global, so that several
+*   threads can sort at once.
+*
 ******************************************************************************/
 
-static int CDECL compboxes(const void *in_a, const void *in_b)
+static int compboxes(const void *in_a, const void *in_b, int Axis)
 {
   BBOX *a, *b;
   BBOX_VAL am, bm;
@@ -1511,6 +1566,25 @@ static int CDECL compboxes(const void *in_a, const void *in_b)
 
 
 
+/* @CoppeliaSim@ */
+
+static int CDECL compboxes_x(const void *in_a, const void *in_b)
+{
+  return (compboxes(in_a, in_b, X));
+}
+
+static int CDECL compboxes_y(const void *in_a, const void *in_b)
+{
+  return (compboxes(in_a, in_b, Y));
+}
+
+static int CDECL compboxes_z(const void *in_a, const void *in_b)
+{
+  return (compboxes(in_a, in_b, Z));
+}
+
+
+
 /*****************************************************************************
 *
 * FUNCTION
@@ -1775,16 +1849,21 @@ static void build_area_table(BBOX_TREE **Finite, long a, long  b, DBL *areas)
 *
 * CHANGES
 *
-*   -
+*   @CoppeliaSim@ The elements are sorted in Finite while the new leaves are
+*   added to Leaves, which may be the same array. If there are Workers left
+*   and both sides of a split are large enough they are split by two
+*   threads, their leaves are then added left side first like they would be
+*   by a single thread.
 *
 ******************************************************************************/
 
-static int sort_and_split(BBOX_TREE **Root, BBOX_TREE **&Finite, long *numOfFiniteObjects, long  first, long  last)
+static int sort_and_split(BBOX_TREE **Root, BBOX_TREE **&Finite, BBOX_TREE **&Leaves, long *numOfLeaves, long *maxLeaves, long first, long last, int Workers)
 {
   BBOX_TREE *cd;
-  long size, i, best_loc;
+  long size, i, j, best_loc;
   DBL *area_left, *area_right;
   DBL best_index, new_index;
+  int Axis;
 
   Axis = find_axis(Finite, first, last);
 
@@ -1803,7 +1882,7 @@ static int sort_and_split(BBOX_TREE **Root, BBOX_TREE **&Finite, long *numOfFini
    * linear algorithm to partition along the axis. Oh well.
    */
 
-  QSORT((void *)(&Finite[first]), (unsigned long)size, sizeof(BBOX_TREE *), compboxes);
+  QSORT((void *)(&Finite[first]), (unsigned long)size, sizeof(BBOX_TREE *), (Axis == X) ? compboxes_x : ((Axis == Y) ? compboxes_y : compboxes_z));
 
   /*
    * area_left[] and area_right[] hold the surface areas of the bounding
@@ -1864,33 +1943,208 @@ static int sort_and_split(BBOX_TREE **Root, BBOX_TREE **&Finite, long *numOfFini
 
     *Root = (BBOX_TREE *)cd;
 
-    if (*numOfFiniteObjects > maxfinitecount)
+    add_leaf(cd, Leaves, numOfLeaves, maxLeaves);
+
+    return (1);
+  }
+
+#ifdef POV_THREADED_BOUNDING
+  /* @CoppeliaSim@ */
+  if ((Workers > 1) && (best_loc + 1 - first >= THREADED_SPLIT_SIZE) && (last - best_loc - 1 >= THREADED_SPLIT_SIZE))
+  {
+    BBOX_SPLIT Parts[2];
+    pthread_t Thread;
+    bool Started;
+
+    Parts[0].First = first;
+    Parts[0].Last = best_loc + 1;
+    Parts[0].Workers = Workers - Workers / 2;
+
+    Parts[1].First = best_loc + 1;
+    Parts[1].Last = last;
+    Parts[1].Workers = Workers / 2;
+
+    for (i = 0; i < 2; i++)
     {
-      /* Prim array overrun, increase array by 50%. */
+      Parts[i].Elements = Finite;
+      Parts[i].Root = NULL;
+      Parts[i].Leaves = NULL;
+      Parts[i].Number_Of_Leaves = Parts[i].Max_Leaves = 0;
+    }
 
-      maxfinitecount = 1.5 * maxfinitecount;
+    /* The right side is done here if its thread could not be started. */
 
-      /* For debugging only. */
+    Started = (pthread_create(&Thread, NULL, split_thread, &Parts[1]) == 0);
 
-      Debug_Info("Reallocing Finite to %d\n", maxfinitecount);
+    split_part(&Parts[0]);
 
-      Finite = (BBOX_TREE **)POV_REALLOC(Finite, maxfinitecount * sizeof(BBOX_TREE *), "bounding boxes");
+    if (Started)
+    {
+      pthread_join(Thread, NULL);
     }
+    else
+    {
+      split_part(&Parts[1]);
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+      for (j = 0; j < Parts[i].Number_Of_Leaves; j++)
+      {
+        add_leaf(Parts[i].Leaves[j], Leaves, numOfLeaves, maxLeaves);
+      }
 
-    Finite[*numOfFiniteObjects] = cd;
+      POV_FREE(Parts[i].Leaves);
+    }
 
-    (*numOfFiniteObjects)++;
+    *Root = Parts[1].Root;
 
-    return (1);
+    return (0);
   }
-  else
+#endif
+
+  sort_and_split(Root, Finite, Leaves, numOfLeaves, maxLeaves, first, best_loc + 1, Workers);
+
+  sort_and_split(Root, Finite, Leaves, numOfLeaves, maxLeaves, best_loc + 1, last, Workers);
+
+  return (0);
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   add_leaf
+*
+* INPUT
+*
+*   Leaf        - New leaf
+*   Leaves      - Array of leaves
+*   numOfLeaves - Number of leaves
+*   maxLeaves   - Size of the array of leaves
+*
+* OUTPUT
+*
+*   Leaves, numOfLeaves, maxLeaves
+*
+* RETURNS
+*
+* AUTHOR
+*
+*   Alexander Enzmann
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Append a leaf to an array of leaves, growing it if needed (extracted
+*   from sort_and_split).
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void add_leaf(BBOX_TREE *Leaf, BBOX_TREE **&Leaves, long *numOfLeaves, long *maxLeaves)
+{
+  if (*numOfLeaves >= *maxLeaves)
   {
-    sort_and_split(Root, Finite, numOfFiniteObjects, first, best_loc + 1);
+    /* Prim array overrun, increase array by 50%. */
 
-    sort_and_split(Root, Finite, numOfFiniteObjects, best_loc + 1, last);
+    *maxLeaves = max(*maxLeaves + 1, (long)(1.5 * *maxLeaves));
 
-    return (0);
+    /* For debugging only, not from threads. */
+
+    // Debug_Info("Reallocing Finite to %d\n", *maxLeaves);
+
+    Leaves = (BBOX_TREE **)POV_REALLOC(Leaves, *maxLeaves * sizeof(BBOX_TREE *), "bounding boxes");
   }
+
+  Leaves[*numOfLeaves] = Leaf;
+
+  (*numOfLeaves)++;
 }
 
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   split_part
+*
+* INPUT
+*
+*   Part - Elements to split
+*
+* OUTPUT
+*
+*   Part
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Split a part of the elements, collecting the leaves in an array of the
+*   part.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void split_part(BBOX_SPLIT *Part)
+{
+  /* There are at most as many leaves as elements. */
+
+  Part->Max_Leaves = Part->Last - Part->First;
+
+  Part->Leaves = (BBOX_TREE **)POV_MALLOC(Part->Max_Leaves * sizeof(BBOX_TREE *), "bounding boxes");
+
+  sort_and_split(&Part->Root, Part->Elements, Part->Leaves, &Part->Number_Of_Leaves, &Part->Max_Leaves, Part->First, Part->Last, Part->Workers);
+}
+
+
+
+#ifdef POV_THREADED_BOUNDING
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   split_thread
+*
+* INPUT
+*
+*   Part - Elements to split
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Thread entry point splitting a part of the elements.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void *split_thread(void *Part)
+{
+  split_part((BBOX_SPLIT *)Part);
+
+  return NULL;
+}
+
+#endif
+
 END_POV_NAMESPACE
@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 /* NOTE: FRAME.H contains other bound stuff. */
 
 #ifndef BBOX_H
@@ -99,7 +105,7 @@ void Recompute_Inverse_BBox (BBOX *bbox, TRANSFORM *trans);
 bool Intersect_BBox_Tree (BBOX_TREE *Root, RAY *ray, INTERSECTION *Best_Intersection, OBJECT **Best_Object, bool shadow_flag);
 void Check_And_Enqueue (PRIORITY_QUEUE *Queue, BBOX_TREE *Node, BBOX *BBox, RAYINFO *rayinfo);
 void Priority_Queue_Delete (PRIORITY_QUEUE *Queue, DBL *key, BBOX_TREE **Node);
-void Build_BBox_Tree (BBOX_TREE **Root, long nFinites, BBOX_TREE **&Finite, long numberOfInfiniteObjects, BBOX_TREE **Infinite);
+void Build_BBox_Tree (BBOX_TREE **Root, long nFinites, BBOX_TREE **&Finite, long numberOfInfiniteObjects, BBOX_TREE **Infinite, int Workers); /* @CoppeliaSim@ */
 void Destroy_BBox_Tree (BBOX_TREE *Node);
 void Create_Rayinfo (RAY *Ray, RAYINFO *rayinfo);
 
@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 #include "frame.h"
 #include "vector.h"
 #include "camera.h"
@@ -180,6 +186,92 @@ void Transform_Camera(CAMERA *Camera, TRANSFORM *Trans)
 
 
 
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Point_Camera
+*
+* INPUT
+*
+*   Camera - Camera to aim at its look_at point
+*
+* OUTPUT
+*
+*   Camera
+*
+* RETURNS
+*
+*   bool - false if the look_at point is at the camera location
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Turn the direction of the camera towards its look_at point and the up
+*   vector towards the sky, keeping the length of every vector and the
+*   handedness of the right vector. This is the look_at step of
+*   Parse_Camera, shared with cameras set up after parsing.
+*
+* CHANGES
+*
+******************************************************************************/
+
+bool Point_Camera(CAMERA *Camera)
+{
+  DBL Direction_Length, Up_Length, Right_Length, Handedness;
+  VECTOR tempv;
+
+  VLength (Direction_Length, Camera->Direction);
+  VLength (Up_Length,        Camera->Up);
+  VLength (Right_Length,     Camera->Right);
+  VCross  (tempv,            Camera->Up, Camera->Direction);
+  VDot    (Handedness,       tempv,      Camera->Right);
+
+  VSub (Camera->Direction, Camera->Look_At, Camera->Location);
+
+  // Check for zero length direction vector.
+  if (VSumSqr(Camera->Direction) < EPSILON)
+    return (false);
+
+  VNormalize (Camera->Direction, Camera->Direction);
+
+  // Save Right vector
+  Assign_Vector (tempv, Camera->Right);
+
+  VCross (Camera->Right, Camera->Sky, Camera->Direction);
+
+  // Avoid DOMAIN error (from Terry Kanakis)
+  if((fabs(Camera->Right[X]) < EPSILON) &&
+     (fabs(Camera->Right[Y]) < EPSILON) &&
+     (fabs(Camera->Right[Z]) < EPSILON))
+  {
+    // Restore Right vector
+    Assign_Vector (Camera->Right, tempv);
+  }
+
+  VNormalize (Camera->Right,     Camera->Right);
+  VCross     (Camera->Up,        Camera->Direction, Camera->Right);
+  VScale     (Camera->Direction, Camera->Direction, Direction_Length);
+
+  if (Handedness > 0.0)
+  {
+    VScaleEq (Camera->Right, Right_Length);
+  }
+  else
+  {
+    VScaleEq (Camera->Right, -Right_Length);
+  }
+
+  VScaleEq (Camera->Up, Up_Length);
+
+  return (true);
+}
+
+
+
 /*****************************************************************************
 *
 * FUNCTION
@@ -238,6 +330,10 @@ CAMERA *Create_Camera()
   /* Do not perturb primary rays by default. [DB 7/94] */
   New->Tnormal = NULL;
 
+  /* No view clipping by default. */
+  New->Near_Distance = 0.0;
+  New->Far_Distance  = 0.0;
+
   New->Trans = Create_Transform();
 
   return (New);
@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 
 #ifndef CAMERA_H
 #define CAMERA_H
@@ -82,6 +88,17 @@ struct Camera_Struct
   DBL V_Angle;                   /* Spherical verticle viewing angle          */
   TNORMAL *Tnormal;              /* Primary ray pertubation.                  */
   TRANSFORM *Trans;              /* Used only to record the user's input      */
+
+  ///////////////////////////////////////////////////////////////////////////////
+  //                                                                           //
+  // @CoppeliaSim@                                                                   //
+  //                                                                           //
+  // View clipping is done on primary rays instead of clipping every object    //
+  //                                                                           //
+  ///////////////////////////////////////////////////////////////////////////////
+
+  DBL Near_Distance;             /* Near clipping distance (0 = none)         */
+  DBL Far_Distance;              /* Far clipping distance (0 = none)          */
 };
 
 
@@ -101,6 +118,7 @@ void Translate_Camera (CAMERA *Cm, VECTOR Vector);
 void Rotate_Camera (CAMERA *Cm, VECTOR Vector);
 void Scale_Camera (CAMERA *Cm, VECTOR Vector);
 void Transform_Camera (CAMERA *Cm, TRANSFORM *Trans);
+bool Point_Camera (CAMERA *Cm); /* @CoppeliaSim@ */
 CAMERA *Copy_Camera (CAMERA *Old);
 CAMERA *Create_Camera (void);
 void Destroy_Camera (CAMERA *Cm);
@@ -65,6 +65,7 @@
 #include "function.h"
 #include "mathutil.h"
 #include "fileinputoutput.h"
+#include "mesh.h" /* @CoppeliaSim@ */
 
 #include <algorithm>
 
@@ -306,6 +307,9 @@ static void Parse_Trace(VECTOR Res)
 
    Parse_Comma();
 
+   /* @CoppeliaSim@ Meshes have to be set up to be traced. */
+   Complete_Mesh_Setup();
+
    if ( Intersection( &Intersect, Object, &Ray ) ) 
    {
      Assign_Vector( Res, Intersect.IPoint );
@@ -398,6 +402,9 @@ static int Parse_Inside()
 
    Parse_Vector(Local_Vector);
 
+   /* @CoppeliaSim@ Meshes have to be set up to be tested. */
+   Complete_Mesh_Setup();
+
    if (Inside_Object(Local_Vector, Object)) 
      Result = 1;
    else
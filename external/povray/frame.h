@@ -30,6 +30,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 #ifndef FRAME_H
 #define FRAME_H
 
@@ -1167,6 +1173,20 @@ struct Image16_Line_Struct
   unsigned short *red, *green, *blue, *transm;
 };
 
+/* @CoppeliaSim@ */
+/* One level of an image's mip chain, stored as RGBT texels in tiles of IMAGE_MIP_TILE_SIZE squared. */
+
+#define IMAGE_MIP_TILE_SIZE 8
+
+typedef struct Image_Mip_Level_Struct IMAGE_MIP_LEVEL;
+
+struct Image_Mip_Level_Struct
+{
+  int iwidth, iheight;
+  int Tiles_Per_Row;
+  unsigned char *texels;
+};
+
 
 
 /*****************************************************************************
@@ -1235,6 +1255,8 @@ struct Image_Struct
     unsigned short **gray16_lines;
     unsigned char **map_lines;
   } data;
+  int Mip_Levels;             /* @CoppeliaSim@ Number of levels in Mip_Chain, 0 if none */
+  IMAGE_MIP_LEVEL *Mip_Chain; /* @CoppeliaSim@ Tiled image, then halved down to 1x1 */
 };
 
 #define PIGMENT_TYPE  0
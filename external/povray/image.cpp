@@ -49,6 +49,8 @@
 #include "fpmetric.h"
 #include "colour.h"
 
+#include <algorithm>
+
 BEGIN_POV_NAMESPACE
 
 /*****************************************************************************
@@ -72,6 +74,17 @@ const DBL DIV_1_BY_255 = 1.0 / 255.0;
 
 
 
+/*****************************************************************************
+* Global variables
+******************************************************************************/
+
+/* @CoppeliaSim@ */
+/* Size of the ray footprint in UV space at the point being textured, 0 if unknown. */
+
+DBL UV_Footprint = 0.0; // GLOBAL VARIABLE
+
+
+
 /*****************************************************************************
 * Static functions
 ******************************************************************************/
@@ -87,6 +100,19 @@ static void Interp (IMAGE * Image, DBL xcoor, DBL ycoor, COLOUR colour, int *ind
 static void image_colour_at (IMAGE * Image, DBL xcoor, DBL ycoor, COLOUR colour, int *index);
 static int map (VECTOR EPoint, TPATTERN * Turb, DBL *xcoor, DBL *ycoor);
 
+/* @CoppeliaSim@ */
+static void mip_map_colour (IMAGE *Image, DBL xcoor, DBL ycoor, DBL Footprint, COLOUR colour, int *index);
+static void mip_bilinear (IMAGE *Image, IMAGE_MIP_LEVEL *Level, DBL xcoor, DBL ycoor, DBL *Texel);
+
+/* Texel x, y of a mip level. */
+
+inline const unsigned char *mip_texel(const IMAGE_MIP_LEVEL *Level, int x, int y)
+{
+  return Level->texels + 4 * ((((unsigned)y / IMAGE_MIP_TILE_SIZE) * Level->Tiles_Per_Row + (unsigned)x / IMAGE_MIP_TILE_SIZE) *
+                              (IMAGE_MIP_TILE_SIZE * IMAGE_MIP_TILE_SIZE) +
+                              ((unsigned)y % IMAGE_MIP_TILE_SIZE) * IMAGE_MIP_TILE_SIZE + (unsigned)x % IMAGE_MIP_TILE_SIZE);
+}
+
 /*
  * 2-D to 3-D Procedural Texture Mapping of a Bitmapped Image onto an Object:
  * 
@@ -147,7 +173,17 @@ int image_map(VECTOR EPoint, PIGMENT *Pigment, COLOUR colour)
   }
   else
   {
-    image_colour_at(Pigment->Vals.Image, xcoor, ycoor, colour, &reg_number);
+    IMAGE *Image = Pigment->Vals.Image;
+
+    /* @CoppeliaSim@ */
+    if ((Image->Mip_Chain != NULL) && (UV_Footprint > 0.0))
+    {
+      mip_map_colour(Image, xcoor, ycoor, UV_Footprint * max(Image->width, Image->height), colour, &reg_number);
+    }
+    else
+    {
+      image_colour_at(Image, xcoor, ycoor, colour, &reg_number);
+    }
   }
 
   return(true);
@@ -1403,6 +1439,322 @@ static void Interp(IMAGE *Image, DBL xcoor, DBL  ycoor, COLOUR colour, int *inde
 
 
 
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Build_Image_Mip_Chain
+*
+* INPUT
+*
+*   Image - 8 bit RGB(T) image
+*
+* OUTPUT
+*
+*   Image
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Copy the image into tiles of IMAGE_MIP_TILE_SIZE squared texels, so that
+*   neighbouring texels share cache lines, and add levels of halved size
+*   down to a single texel, each averaging blocks of 2x2 texels of the
+*   level above. Image maps looked up from far away then read a level
+*   matching the ray footprint instead of aliasing.
+*
+* CHANGES
+*
+******************************************************************************/
+
+void Build_Image_Mip_Chain(IMAGE *Image)
+{
+  int i, x, y, c, Levels, iwidth, iheight;
+  IMAGE8_LINE *line;
+  IMAGE_MIP_LEVEL *Level, *Parent;
+  unsigned char *Texel;
+  const unsigned char *T1, *T2, *T3, *T4;
+
+  if ((Image->Colour_Map != NULL) || ((Image->Image_Type & IS16BITIMAGE) == IS16BITIMAGE) ||
+      (Image->iwidth <= 0) || (Image->iheight <= 0) || (Image->Mip_Chain != NULL))
+  {
+    return;
+  }
+
+  Levels = 1;
+
+  for (iwidth = Image->iwidth, iheight = Image->iheight; (iwidth > 1) || (iheight > 1); Levels++)
+  {
+    iwidth = max(1, iwidth / 2);
+    iheight = max(1, iheight / 2);
+  }
+
+  Image->Mip_Chain = (IMAGE_MIP_LEVEL *)POV_MALLOC(Levels * sizeof(IMAGE_MIP_LEVEL), "image mip chain");
+  Image->Mip_Levels = Levels;
+
+  iwidth = Image->iwidth;
+  iheight = Image->iheight;
+
+  for (i = 0; i < Levels; i++)
+  {
+    Level = &Image->Mip_Chain[i];
+
+    Level->iwidth = iwidth;
+    Level->iheight = iheight;
+    Level->Tiles_Per_Row = (iwidth + IMAGE_MIP_TILE_SIZE - 1) / IMAGE_MIP_TILE_SIZE;
+    Level->texels = (unsigned char *)POV_MALLOC((size_t)Level->Tiles_Per_Row *
+                                                ((iheight + IMAGE_MIP_TILE_SIZE - 1) / IMAGE_MIP_TILE_SIZE) *
+                                                IMAGE_MIP_TILE_SIZE * IMAGE_MIP_TILE_SIZE * 4, "image mip level");
+
+    for (y = 0; y < iheight; y++)
+    {
+      line = &Image->data.rgb8_lines[y];
+
+      for (x = 0; x < iwidth; x++)
+      {
+        Texel = (unsigned char *)mip_texel(Level, x, y);
+
+        if (i == 0)
+        {
+          /* Full-size level, transmit defaults to opaque */
+
+          Texel[0] = line->red[x];
+          Texel[1] = line->green[x];
+          Texel[2] = line->blue[x];
+          Texel[3] = (line->transm != NULL) ? line->transm[x] : 0;
+        }
+        else
+        {
+          Parent = &Image->Mip_Chain[i - 1];
+
+          T1 = mip_texel(Parent, min(2 * x, Parent->iwidth - 1), min(2 * y, Parent->iheight - 1));
+          T2 = mip_texel(Parent, min(2 * x + 1, Parent->iwidth - 1), min(2 * y, Parent->iheight - 1));
+          T3 = mip_texel(Parent, min(2 * x, Parent->iwidth - 1), min(2 * y + 1, Parent->iheight - 1));
+          T4 = mip_texel(Parent, min(2 * x + 1, Parent->iwidth - 1), min(2 * y + 1, Parent->iheight - 1));
+
+          for (c = 0; c < 4; c++)
+          {
+            Texel[c] = (unsigned char)((T1[c] + T2[c] + T3[c] + T4[c] + 2) / 4);
+          }
+        }
+      }
+    }
+
+    iwidth = max(1, iwidth / 2);
+    iheight = max(1, iheight / 2);
+  }
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   mip_map_colour
+*
+* INPUT
+*
+*   Image        - Image with a mip chain
+*   xcoor, ycoor - Position in the full-size image
+*   Footprint    - Size of the ray footprint in full-size texels
+*
+* OUTPUT
+*
+*   colour, index
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Look up an image through its mip chain. Footprints up to one texel read
+*   the full-size image as image_colour_at does, larger ones interpolate
+*   bilinearly within and linearly between the two levels whose texel size
+*   brackets the footprint (trilinear filtering).
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void mip_map_colour(IMAGE *Image, DBL xcoor, DBL ycoor, DBL Footprint, COLOUR colour, int *index)
+{
+  int i, Level;
+  DBL Lod, Weight;
+  DBL Texel[4], Filtered[4];
+  const unsigned char *T;
+
+  if (Footprint <= 1.0)
+  {
+    if (Image->Interpolation_Type != NO_INTERPOLATION)
+    {
+      image_colour_at(Image, xcoor, ycoor, colour, index);
+
+      return;
+    }
+
+    /* Same wrapping as no_interpolation. */
+
+    if (Image->Once_Flag)
+    {
+      if (xcoor < 0.0)
+        xcoor = 0.0;
+      else if (xcoor >= (DBL)Image->iwidth)
+        xcoor -= 1.0;
+
+      if (ycoor < 0.0)
+        ycoor = 0.0;
+      else if (ycoor >= (DBL)Image->iheight)
+        ycoor -= 1.0;
+    }
+    else
+    {
+      if (xcoor < 0.0)
+        xcoor += (DBL)Image->iwidth;
+      else if (xcoor >= (DBL)Image->iwidth)
+        xcoor -= (DBL)Image->iwidth;
+
+      if (ycoor < 0.0)
+        ycoor += (DBL)Image->iheight;
+      else if (ycoor >= (DBL)Image->iheight)
+        ycoor -= (DBL)Image->iheight;
+    }
+
+    T = mip_texel(&Image->Mip_Chain[0], (int)xcoor, (int)ycoor);
+
+    for (i = 0; i < 4; i++)
+    {
+      Filtered[i] = (DBL)T[i];
+    }
+  }
+  else
+  {
+    Lod = log(Footprint) / log(2.0);
+
+    Level = (int)Lod;
+
+    if (Level >= Image->Mip_Levels - 1)
+    {
+      Level = Image->Mip_Levels - 1;
+
+      Weight = 0.0;
+    }
+    else
+    {
+      Weight = Lod - (DBL)Level;
+    }
+
+    mip_bilinear(Image, &Image->Mip_Chain[Level], xcoor, ycoor, Filtered);
+
+    if (Weight > 0.0)
+    {
+      mip_bilinear(Image, &Image->Mip_Chain[Level + 1], xcoor, ycoor, Texel);
+
+      for (i = 0; i < 4; i++)
+      {
+        Filtered[i] += Weight * (Texel[i] - Filtered[i]);
+      }
+    }
+  }
+
+  colour[pRED] += Filtered[0] * DIV_1_BY_255;
+  colour[pGREEN] += Filtered[1] * DIV_1_BY_255;
+  colour[pBLUE] += Filtered[2] * DIV_1_BY_255;
+  colour[pTRANSM] += Filtered[3] * DIV_1_BY_255;
+
+  /* Note: Transmit_all suppliments alpha channel */
+  colour[pTRANSM] += Image->AllTransmit;
+  colour[pFILTER] += Image->AllFilter;
+
+  *index = -1;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   mip_bilinear
+*
+* INPUT
+*
+*   Image        - Image the level belongs to
+*   Level        - Level of the mip chain
+*   xcoor, ycoor - Position in the full-size image
+*
+* OUTPUT
+*
+*   Texel        - Interpolated RGBT values (0..255)
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Bilinear interpolation between the texel centres of a mip level,
+*   wrapping around repeated images and clamping at the border otherwise.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void mip_bilinear(IMAGE *Image, IMAGE_MIP_LEVEL *Level, DBL xcoor, DBL ycoor, DBL *Texel)
+{
+  int i, x0, y0, x1, y1;
+  DBL x, y, p, q;
+  const unsigned char *T1, *T2, *T3, *T4;
+
+  x = xcoor * (DBL)Level->iwidth / (DBL)Image->iwidth - 0.5;
+  y = ycoor * (DBL)Level->iheight / (DBL)Image->iheight - 0.5;
+
+  x0 = (int)floor(x);
+  y0 = (int)floor(y);
+
+  p = x - (DBL)x0;
+  q = y - (DBL)y0;
+
+  x1 = x0 + 1;
+  y1 = y0 + 1;
+
+  if (Image->Once_Flag)
+  {
+    x0 = max(0, min(x0, Level->iwidth - 1));
+    x1 = max(0, min(x1, Level->iwidth - 1));
+    y0 = max(0, min(y0, Level->iheight - 1));
+    y1 = max(0, min(y1, Level->iheight - 1));
+  }
+  else
+  {
+    x0 = (x0 + Level->iwidth) % Level->iwidth;
+    x1 = x1 % Level->iwidth;
+    y0 = (y0 + Level->iheight) % Level->iheight;
+    y1 = y1 % Level->iheight;
+  }
+
+  T1 = mip_texel(Level, x0, y0);
+  T2 = mip_texel(Level, x1, y0);
+  T3 = mip_texel(Level, x0, y1);
+  T4 = mip_texel(Level, x1, y1);
+
+  for (i = 0; i < 4; i++)
+  {
+    Texel[i] = (1.0 - q) * ((1.0 - p) * T1[i] + p * T2[i]) + q * ((1.0 - p) * T3[i] + p * T4[i]);
+  }
+}
+
+
+
 /*****************************************************************************
 *
 * FUNCTION
@@ -1569,6 +1921,9 @@ IMAGE *Create_Image()
 
   Image->Object = NULL;
 
+  Image->Mip_Levels = 0;
+  Image->Mip_Chain = NULL;
+
   return (Image);
 }
 
@@ -1647,6 +2002,19 @@ void Destroy_Image(IMAGE *Image)
     return;
   }
 
+  /* @CoppeliaSim@ */
+  if (Image->Mip_Chain != NULL)
+  {
+    for (i = 0; i < Image->Mip_Levels; i++)
+    {
+      POV_FREE(Image->Mip_Chain[i].texels);
+    }
+
+    POV_FREE(Image->Mip_Chain);
+
+    Image->Mip_Chain = NULL;
+  }
+
   if (Image->Colour_Map != NULL)
   {
     POV_FREE(Image->Colour_Map);
@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 
 #ifndef IMAGE_H
 #define IMAGE_H
@@ -81,6 +87,7 @@ BEGIN_POV_NAMESPACE
 * Global variables
 ******************************************************************************/
 
+extern DBL UV_Footprint; /* @CoppeliaSim@ */
 
 
 
@@ -97,6 +104,7 @@ bool is_image_opaque(IMAGE *Image);
 IMAGE *Copy_Image (IMAGE *Old);
 IMAGE *Create_Image (void);
 void Destroy_Image (IMAGE *Image);
+void Build_Image_Mip_Chain (IMAGE *Image); /* @CoppeliaSim@ */
 
 END_POV_NAMESPACE
 
@@ -158,6 +158,14 @@ ComTexData *ComputeTextureUsedPool = NULL; // GLOBAL VARIABLE
 ComTexData *ComputeTextureFreePool = NULL; // GLOBAL VARIABLE
 int ComputeTexturePoolSize = 0; // GLOBAL VARIABLE
 
+/* @CoppeliaSim@ */
+/* light culling grid over the scene, see Build_Light_Culling_Grid */
+LIGHT_SOURCE **Culling_Lights = NULL;  /* light sources by index */ // GLOBAL VARIABLE
+int *Culling_Cell_Start = NULL;        /* first entry of each cell in Culling_Cell_Lights */ // GLOBAL VARIABLE
+int *Culling_Cell_Lights = NULL;       /* indices of the lights that can reach each cell */ // GLOBAL VARIABLE
+int Culling_Grid_Size[3]; // GLOBAL VARIABLE
+VECTOR Culling_Grid_Lower, Culling_Cell_Size; // GLOBAL VARIABLE
+
 /*****************************************************************************
 * Global variables
 ******************************************************************************/
@@ -198,6 +206,10 @@ long MaxLightedTexture=-1; // GLOBAL VARIABLE
 ******************************************************************************/
 /* ------- cache init / reinit / deinit -------- */
 static void InitMallocPools(void);
+static bool Light_Reaches_Sphere (LIGHT_SOURCE *Light, VECTOR Center, DBL Radius); /* @CoppeliaSim@ */
+static const int *Light_Culling_Cell (VECTOR IPoint, int *Number_Of_Lights); /* @CoppeliaSim@ */
+static DBL Ray_UV_Footprint (INTERSECTION *Ray_Intersection, VECTOR Raw_Normal, RAY *Ray); /* @CoppeliaSim@ */
+static DBL Russian_Roulette (VECTOR IPoint, DBL Weight, int Salt); /* @CoppeliaSim@ */
 static void DeInitMallocPools(void);
 static void ReInitMallocPools(void);
 
@@ -509,10 +521,15 @@ void Determine_Apparent_Colour(INTERSECTION *Ray_Intersection, COLOUR Colour, RA
   TEXTURE **save_Textures = NULL;
   TEXTURE *Texture;
   LIGHT_TESTED *savelights = NULL;
+  DBL save_UV_Footprint; /* @CoppeliaSim@ */
 
 
   Total_Depth += Ray_Intersection->Depth;
 
+  /* @CoppeliaSim@ */
+  save_UV_Footprint = UV_Footprint;
+  UV_Footprint = 0.0;
+
   Assign_Vector(IPoint,Ray_Intersection->IPoint);
 
   /*
@@ -575,6 +592,10 @@ void Determine_Apparent_Colour(INTERSECTION *Ray_Intersection, COLOUR Colour, RA
     UVCoord(UV_Coords, Ray_Intersection->Object, Ray_Intersection);
     /* save the normal and UV coords into Intersection */
     Assign_UV_Vect(Ray_Intersection->Iuv, UV_Coords);
+
+    /* @CoppeliaSim@ */
+    if (!backtraceFlag)
+      UV_Footprint = Ray_UV_Footprint(Ray_Intersection, Raw_Normal, Ray);
   }
 
   /* now switch to UV mapping if we need to */
@@ -653,6 +674,8 @@ void Determine_Apparent_Colour(INTERSECTION *Ray_Intersection, COLOUR Colour, RA
 
   /* NK depth */
   Total_Depth -= Ray_Intersection->Depth;
+
+  UV_Footprint = save_UV_Footprint; /* @CoppeliaSim@ */
 }
 
 
@@ -2286,7 +2309,8 @@ static void Diffuse (FINISH *Finish, VECTOR IPoint, RAY *Eye, VECTOR  Layer_Norm
 {
     LIGHT_SOURCE *Light_Source;
     VECTOR REye;
-    int i;
+    int i, k, n;
+    const int *Cell_Lights;
 
     if ((Finish->Diffuse == 0.0) && (Finish->Specular == 0.0) && (Finish->Phong == 0.0))
     {
@@ -2303,11 +2327,24 @@ static void Diffuse (FINISH *Finish, VECTOR IPoint, RAY *Eye, VECTOR  Layer_Norm
     // global light sources, if not turned off for this object
     if((Object->Flags & NO_GLOBAL_LIGHTS_FLAG) != NO_GLOBAL_LIGHTS_FLAG)
     {
-        for (i = 0, Light_Source = Frame.Light_Sources;
-           Light_Source != NULL;
-           Light_Source = Light_Source->Next_Light_Source, i++)
+        /* @CoppeliaSim@ */
+        /* only visit the lights that can reach the point's grid cell, if any */
+        if ((Cell_Lights = Light_Culling_Cell(IPoint, &n)) != NULL)
         {
-            Diffuse_One_Light(Light_Source, i, REye, Finish, IPoint, Eye, Layer_Normal, Layer_Pigment_Colour, Colour, Attenuation, Object);
+            for (k = 0; k < n; k++)
+            {
+                i = Cell_Lights[k];
+                Diffuse_One_Light(Culling_Lights[i], i, REye, Finish, IPoint, Eye, Layer_Normal, Layer_Pigment_Colour, Colour, Attenuation, Object);
+            }
+        }
+        else
+        {
+            for (i = 0, Light_Source = Frame.Light_Sources;
+               Light_Source != NULL;
+               Light_Source = Light_Source->Next_Light_Source, i++)
+            {
+                Diffuse_One_Light(Light_Source, i, REye, Finish, IPoint, Eye, Layer_Normal, Layer_Pigment_Colour, Colour, Attenuation, Object);
+            }
         }
     }
     // local light sources from a light group, if any
@@ -3496,6 +3533,56 @@ static int create_texture_list(INTERSECTION *Ray_Intersection, DBL realNormDir)
 
 
 
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Ray_UV_Footprint
+*
+* INPUT
+*
+*   Ray_Intersection - Intersection being textured
+*   Raw_Normal       - Surface normal, facing the ray
+*   Ray              - Ray hitting the surface
+*
+* OUTPUT
+*
+* RETURNS
+*
+*   DBL - Size of the ray footprint in UV space, 0 if unknown
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Lets image maps pick a mip level: the pixel's width at the distance
+*   traveled from the camera, stretched by grazing incidence (at most 4x)
+*   and scaled by the UV density of the mesh triangle hit. Other objects
+*   have no UV density and get 0, i.e. unfiltered lookups.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static DBL Ray_UV_Footprint(INTERSECTION *Ray_Intersection, VECTOR Raw_Normal, RAY *Ray)
+{
+  DBL Cos_Incidence;
+
+  if ((Ray_Intersection->Object->Methods != &Mesh_Methods) || (Ray_Intersection->Pointer == NULL))
+    return 0.0;
+
+  VDot(Cos_Incidence, Raw_Normal, Ray->Direction);
+
+  Cos_Incidence = max(fabs(Cos_Incidence), 0.25);
+
+  return Mesh_UV_Scale((MESH *)Ray_Intersection->Object, (MESH_TRIANGLE *)Ray_Intersection->Pointer) *
+         (Pixel_Footprint_Width + Pixel_Footprint_Angle * Total_Depth) / Cos_Incidence;
+}
+
+
+
 /*****************************************************************************
 *
 * FUNCTION
@@ -3551,6 +3638,7 @@ static void do_texture_map(COLOUR Result_Colour, TEXTURE *Texture, VECTOR IPoint
   UV_VECT UV_Coords;
   TEXTURE* t;
   bool decWarpNormalTextures = false;
+  DBL save_UV_Footprint; /* @CoppeliaSim@ */
   /* 
      ipoint - interseciton point (and evaluation point)
      epoint - evaluation point
@@ -3610,9 +3698,15 @@ static void do_texture_map(COLOUR Result_Colour, TEXTURE *Texture, VECTOR IPoint
                 //                                                                           //
                 ///////////////////////////////////////////////////////////////////////////////
                 
+            /* @CoppeliaSim@ */
+            save_UV_Footprint = UV_Footprint;
+            UV_Footprint = ((Shadow_Flag) || (backtraceFlag)) ? 0.0 : Ray_UV_Footprint(Ray_Intersection, Raw_Normal, Ray);
+
             TPATTERN* nxt = t->Next; t->Next = Texture->Next;
             do_texture_map(Result_Colour, t, TPoint, Raw_Normal, Ray, Weight, Ray_Intersection, Shadow_Flag);
             t->Next = nxt;
+
+            UV_Footprint = save_UV_Footprint; /* @CoppeliaSim@ */
         }
         break;
       case BITMAP_PATTERN:
@@ -3690,6 +3784,85 @@ static void do_texture_map(COLOUR Result_Colour, TEXTURE *Texture, VECTOR IPoint
 
 
 
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Russian_Roulette
+*
+* INPUT
+*
+*   IPoint - Point the ray leaves from
+*   Weight - Weight of the ray
+*   Salt   - Tells the rays leaving the same point apart
+*
+* OUTPUT
+*
+* RETURNS
+*
+*   DBL - 0 to end the ray, else the factor to scale its weight and colour by
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Rays weighing less than opts.Roulette_Weight go on with a probability
+*   of their weight over it, and have their contribution scaled up by the
+*   inverse, so that the expected colour is unchanged while most faint
+*   rays end early. Rays below ADC_Bailout are left to Trace. The random
+*   numbers are hashed from the point and salt, so every backend and every
+*   frame of a still scene decide alike.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static DBL Russian_Roulette(VECTOR IPoint, DBL Weight, int Salt)
+{
+  int i;
+  unsigned int Hash, Bits;
+  float Coordinate;
+  DBL Survival;
+
+  if ((opts.Roulette_Weight <= 0.0) || (Weight >= opts.Roulette_Weight) ||
+      (Weight < ADC_Bailout) || backtraceFlag)
+  {
+    return (1.0);
+  }
+
+  Hash = 0x9E3779B9u * (unsigned int)(Trace_Level * 8 + Salt + 1);
+
+  for (i = X; i <= Z; i++)
+  {
+    Coordinate = (float)IPoint[i];
+    memcpy(&Bits, &Coordinate, sizeof(Bits));
+    Hash ^= Bits + 0x9E3779B9u + (Hash << 6) + (Hash >> 2);
+  }
+
+  Hash ^= Hash >> 16;
+  Hash *= 0x7FEB352Du;
+  Hash ^= Hash >> 15;
+  Hash *= 0x846CA68Bu;
+  Hash ^= Hash >> 16;
+
+  Survival = Weight / opts.Roulette_Weight;
+
+  if ((DBL)(Hash & 0xFFFFFF) / 16777216.0 >= Survival)
+  {
+    Render_Statistics.Roulette_Terminated++;
+
+    return (0.0);
+  }
+
+  Render_Statistics.Roulette_Survived++;
+
+  return (1.0 / Survival);
+}
+
+
+
 /*****************************************************************************
 *
 * FUNCTION
@@ -3752,6 +3925,7 @@ static void compute_lighted_texture(COLOUR ResCol, TEXTURE *Texture, VECTOR IPoi
   DBL Cos_Angle_Incidence;
   TEXTURE *Layer;
   int    TIR_occured;
+  DBL Roulette; /* @CoppeliaSim@ */
 
   ComTexData *ctd = NewComTexData();
 
@@ -4081,7 +4255,21 @@ static void compute_lighted_texture(COLOUR ResCol, TEXTURE *Texture, VECTOR IPoi
 
     /* Trace refracted ray. */
 
-    TIR_occured = Refract(Interior, Intersect->IPoint, Ray, TopNormal, Raw_Normal, RfrCol, New_Weight);
+    /* @CoppeliaSim@ */
+    Roulette = Russian_Roulette(Intersect->IPoint, New_Weight, 0);
+
+    if (Roulette > 0.0)
+    {
+      TIR_occured = Refract(Interior, Intersect->IPoint, Ray, TopNormal, Raw_Normal, RfrCol, New_Weight * Roulette);
+
+      RfrCol[pRED] *= Roulette;
+      RfrCol[pGREEN] *= Roulette;
+      RfrCol[pBLUE] *= Roulette;
+    }
+    else
+    {
+      Make_ColourA(RfrCol, 0.0, 0.0, 0.0, 0.0, 0.0);
+    }
 
     // Since we've done a refraction, we may have gathered photons and
     // overwritten the ones we had before.  So, we want to make a note of
@@ -4163,8 +4351,24 @@ static void compute_lighted_texture(COLOUR ResCol, TEXTURE *Texture, VECTOR IPoi
             (ListReflec[i][1] != 0.0) ||
             (ListReflec[i][2] != 0.0))
         {
-          Reflect(Intersect->IPoint, Ray,
-            ListNormal[i], Raw_Normal, RflCol, ListWeight[i]);
+          /* @CoppeliaSim@ */
+          /* Reflections raised to a power cannot be scaled back unbiased. */
+          Roulette = (ListReflEx[i] != 1.0) ? 1.0 : Russian_Roulette(Intersect->IPoint, ListWeight[i], i + 1);
+
+          if (Roulette > 0.0)
+          {
+            Reflect(Intersect->IPoint, Ray,
+              ListNormal[i], Raw_Normal, RflCol, ListWeight[i] * Roulette);
+
+            RflCol[pRED] *= Roulette;
+            RflCol[pGREEN] *= Roulette;
+            RflCol[pBLUE] *= Roulette;
+          }
+          else
+          {
+            Make_ColourA(RflCol, 0.0, 0.0, 0.0, 0.0, 0.0);
+          }
+
           // Since we've done a refleciton, we may have gathered photons and
           // overwritten the ones we had before.  So, we want to make a note of
           // it so that we don't try any tricky reuse stuff for the next layer
@@ -6314,4 +6518,335 @@ void FreeComTexData(ComTexData *ctd)
     ComputeTextureFreePool = ctd;
 }
 
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Build_Light_Culling_Grid
+*
+* INPUT
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Split the bounding box of the finite objects into a grid and list for
+*   each cell the light sources that can reach it, given their spot cones
+*   and their fade distance down to LIGHT_CULLING_CUTOFF. Diffuse then only
+*   visits these lights, in the original order. Points outside the grid see
+*   all lights.
+*
+* CHANGES
+*
+******************************************************************************/
+
+void Build_Light_Culling_Grid()
+{
+  int i, j, n, x, y, z, cell, cells;
+  DBL Max_Length, Radius;
+  VECTOR Lower, Upper, Center;
+  OBJECT *Object;
+  LIGHT_SOURCE *Light;
+  bool found = false;
+
+  Destroy_Light_Culling_Grid();
+
+  if (Frame.Number_Of_Light_Sources < LIGHT_CULLING_MIN_LIGHTS)
+  {
+    return;
+  }
+
+  /* Bounds of the finite objects. */
+
+  for (Object = Frame.Objects; Object != NULL; Object = Object->Sibling)
+  {
+    if ((Object->BBox.Lengths[X] > CRITICAL_LENGTH) ||
+        (Object->BBox.Lengths[Y] > CRITICAL_LENGTH) ||
+        (Object->BBox.Lengths[Z] > CRITICAL_LENGTH))
+    {
+      continue;
+    }
+
+    for (i = X; i <= Z; i++)
+    {
+      if (!found || (Object->BBox.Lower_Left[i] < Lower[i]))
+        Lower[i] = Object->BBox.Lower_Left[i];
+      if (!found || (Object->BBox.Lower_Left[i] + Object->BBox.Lengths[i] > Upper[i]))
+        Upper[i] = Object->BBox.Lower_Left[i] + Object->BBox.Lengths[i];
+    }
+
+    found = true;
+  }
+
+  if (!found)
+  {
+    return;
+  }
+
+  /* Roughly cubic cells, at most LIGHT_CULLING_GRID_SIZE along each axis. */
+
+  Max_Length = max3(Upper[X] - Lower[X], Upper[Y] - Lower[Y], Upper[Z] - Lower[Z]) + EPSILON;
+
+  cells = 1;
+
+  for (i = X; i <= Z; i++)
+  {
+    Culling_Grid_Size[i] = max(1, min((int)ceil(LIGHT_CULLING_GRID_SIZE * (Upper[i] - Lower[i]) / Max_Length), LIGHT_CULLING_GRID_SIZE));
+    Culling_Cell_Size[i] = (Upper[i] - Lower[i] + EPSILON) / Culling_Grid_Size[i];
+    Culling_Grid_Lower[i] = Lower[i] - EPSILON / 2.0;
+    cells *= Culling_Grid_Size[i];
+  }
+
+  VLength(Radius, Culling_Cell_Size);
+  Radius /= 2.0;
+
+  Culling_Lights = (LIGHT_SOURCE **)POV_MALLOC(Frame.Number_Of_Light_Sources*sizeof(LIGHT_SOURCE *), "light culling grid");
+
+  for (i = 0, Light = Frame.Light_Sources; Light != NULL; Light = Light->Next_Light_Source, i++)
+  {
+    Culling_Lights[i] = Light;
+  }
+
+  /* Count, then list the lights reaching each cell. */
+
+  Culling_Cell_Start = (int *)POV_MALLOC((cells + 1)*sizeof(int), "light culling grid");
+  Culling_Cell_Lights = NULL;
+
+  for (j = 0; j < 2; j++)
+  {
+    n = 0;
+
+    for (z = 0, cell = 0; z < Culling_Grid_Size[Z]; z++)
+    {
+      for (y = 0; y < Culling_Grid_Size[Y]; y++)
+      {
+        for (x = 0; x < Culling_Grid_Size[X]; x++, cell++)
+        {
+          Center[X] = Culling_Grid_Lower[X] + (x + 0.5) * Culling_Cell_Size[X];
+          Center[Y] = Culling_Grid_Lower[Y] + (y + 0.5) * Culling_Cell_Size[Y];
+          Center[Z] = Culling_Grid_Lower[Z] + (z + 0.5) * Culling_Cell_Size[Z];
+
+          Culling_Cell_Start[cell] = n;
+
+          for (i = 0; i < Frame.Number_Of_Light_Sources; i++)
+          {
+            if (Light_Reaches_Sphere(Culling_Lights[i], Center, Radius))
+            {
+              if (Culling_Cell_Lights != NULL)
+                Culling_Cell_Lights[n] = i;
+              n++;
+            }
+          }
+        }
+      }
+    }
+
+    Culling_Cell_Start[cells] = n;
+
+    if (j == 0)
+    {
+      Culling_Cell_Lights = (int *)POV_MALLOC(max(1, n)*sizeof(int), "light culling grid");
+    }
+  }
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Destroy_Light_Culling_Grid
+*
+* INPUT
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Free the light culling grid.
+*
+* CHANGES
+*
+******************************************************************************/
+
+void Destroy_Light_Culling_Grid()
+{
+  if (Culling_Lights != NULL)
+    POV_FREE(Culling_Lights);
+  if (Culling_Cell_Start != NULL)
+    POV_FREE(Culling_Cell_Start);
+  if (Culling_Cell_Lights != NULL)
+    POV_FREE(Culling_Cell_Lights);
+
+  Culling_Lights = NULL;
+  Culling_Cell_Start = NULL;
+  Culling_Cell_Lights = NULL;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Light_Reaches_Sphere
+*
+* INPUT
+*
+*   Light  - Light source
+*   Center - Center of the sphere
+*   Radius - Radius of the sphere
+*
+* OUTPUT
+*
+* RETURNS
+*
+*   bool - false if the light surely does not reach any point in the sphere
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   A spotlight only reaches points inside its falloff cone (or in front of
+*   it without one), a faded light only reaches points up to where its
+*   attenuated colour falls below LIGHT_CULLING_CUTOFF (see Attenuate_Light).
+*   Parallel lights fade with the depth along their direction, which is no
+*   more than the distance, and their spotlight cone is not tested.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static bool Light_Reaches_Sphere(LIGHT_SOURCE *Light, VECTOR Center, DBL Radius)
+{
+  DBL Distance, Depth, Length, Colour, Range, Cos_Angle, Cone;
+  VECTOR D, Axis;
+
+  VSub(D, Center, Light->Center);
+  VLength(Distance, D);
+
+  Depth = Distance;
+
+  if (Light->Parallel)
+  {
+    VSub(Axis, Light->Points_At, Light->Center);
+    VLength(Length, Axis);
+    VDot(Depth, D, Axis);
+
+    Depth = (Length > EPSILON) ? fabs(Depth) / Length : 0.0;
+  }
+
+  if ((Light->Fade_Power > 0.0) && (Light->Fade_Distance > EPSILON))
+  {
+    Colour = max3(fabs(Light->Colour[pRED]), fabs(Light->Colour[pGREEN]), fabs(Light->Colour[pBLUE]));
+
+    if (2.0 * Colour <= LIGHT_CULLING_CUTOFF)
+    {
+      return false;
+    }
+
+    Range = Light->Fade_Distance * pow(2.0 * Colour / LIGHT_CULLING_CUTOFF - 1.0, 1.0 / Light->Fade_Power);
+
+    if (Depth - Radius > Range)
+    {
+      return false;
+    }
+  }
+
+  if ((Light->Light_Type == SPOT_SOURCE) && !Light->Parallel && (Distance > Radius))
+  {
+    if (Light->Radius > 0.0)
+      Cone = acos(max(0.0, min(1.0, min(Light->Radius, Light->Falloff))));
+    else
+      Cone = M_PI_2;
+
+    VDot(Cos_Angle, D, Light->Direction);
+    Cos_Angle = max(-1.0, min(1.0, Cos_Angle / Distance));
+
+    if (acos(Cos_Angle) - asin(Radius / Distance) > Cone + EPSILON)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Light_Culling_Cell
+*
+* INPUT
+*
+*   IPoint - Point to light
+*
+* OUTPUT
+*
+*   Number_Of_Lights - Number of lights reaching the point's cell
+*
+* RETURNS
+*
+*   const int * - Light indices, NULL if there is no grid or the point is
+*                 outside of it
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+* CHANGES
+*
+******************************************************************************/
+
+static const int *Light_Culling_Cell(VECTOR IPoint, int *Number_Of_Lights)
+{
+  int i, c[3], cell;
+  DBL d;
+
+  if (Culling_Cell_Start == NULL)
+  {
+    return NULL;
+  }
+
+  for (i = X; i <= Z; i++)
+  {
+    d = (IPoint[i] - Culling_Grid_Lower[i]) / Culling_Cell_Size[i];
+
+    if ((d < 0.0) || (d >= Culling_Grid_Size[i]))
+    {
+      return NULL;
+    }
+
+    c[i] = (int)d;
+  }
+
+  cell = (c[Z] * Culling_Grid_Size[Y] + c[Y]) * Culling_Grid_Size[X] + c[X];
+
+  *Number_Of_Lights = Culling_Cell_Start[cell + 1] - Culling_Cell_Start[cell];
+
+  return Culling_Cell_Lights + Culling_Cell_Start[cell];
+}
+
 END_POV_NAMESPACE
@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 
 #ifndef LIGHTING_H
 #define LIGHTING_H
@@ -45,6 +51,13 @@ BEGIN_POV_NAMESPACE
 /* How many subrays to trace for dispersive media */
 #define DEFAULT_DISP_NELEMS  7
 
+/* @CoppeliaSim@ */
+/* Light culling: minimum number of lights, cells along the longest scene
+   axis and colour below which a faded light is taken as out of reach */
+#define LIGHT_CULLING_MIN_LIGHTS  4
+#define LIGHT_CULLING_GRID_SIZE   16
+#define LIGHT_CULLING_CUTOFF      (0.5 / 255.0)
+
 
 
 /*****************************************************************************
@@ -96,6 +109,8 @@ void do_specular (FINISH *Finish, RAY *Light_Source_Ray,
 
 void ResizeMediaMallocPools(long newSize);
 void ResizeLightMallocPools(long newSize);
+void Build_Light_Culling_Grid (void); /* @CoppeliaSim@ */
+void Destroy_Light_Culling_Grid (void); /* @CoppeliaSim@ */
 
 END_POV_NAMESPACE
 
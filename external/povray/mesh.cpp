@@ -31,6 +31,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 /****************************************************************************
 *
 *  Explanation:
@@ -65,6 +71,13 @@
 
 #include <algorithm>
 
+/* @CoppeliaSim@ */
+#if defined(__linux)
+#include <unistd.h>
+#include <pthread.h>
+#define POV_THREADED_MESH_SETUP 1
+#endif
+
 BEGIN_POV_NAMESPACE
 
 /*****************************************************************************
@@ -86,6 +99,7 @@ const int INITIAL_NUMBER_OF_ENTRIES = 256;
 
 typedef struct Hash_Table_Struct HASH_TABLE;
 typedef struct UV_Hash_Table_Struct UV_HASH_TABLE;
+typedef struct Mesh_Setup_Struct MESH_SETUP; /* @CoppeliaSim@ */
 
 struct Hash_Table_Struct
 {
@@ -101,6 +115,31 @@ struct UV_Hash_Table_Struct
   UV_HASH_TABLE *Next;
 };
 
+/* @CoppeliaSim@ */
+/* Triangles and bounding box tree of a mesh still to be set up. */
+
+struct Mesh_Setup_Struct
+{
+  MESH *Mesh;                    /* Copy sharing the mesh data.       */
+  int *Indices;                  /* Vertex, normal and UV indices.    */
+  long Number_Of_Triangles;      /* Number of triangles in Indices.   */
+  MESH_SETUP *Next;
+};
+
+/* @CoppeliaSim@ */
+/* Mesh setups shared by the threads doing them. */
+
+typedef struct
+{
+  MESH_SETUP **Setups;
+  int Number_Of_Setups;
+  int Next_Setup;
+  int Workers;                   /* Threads building each tree.       */
+#ifdef POV_THREADED_MESH_SETUP
+  pthread_mutex_t Lock;
+#endif
+} MESH_SETUP_POOL;
+
 
 /*****************************************************************************
 * Static functions
@@ -138,6 +177,12 @@ static void get_triangle_uvcoords (MESH *Mesh, MESH_TRIANGLE *Triangle, UV_VECT
 static int mesh_hash (HASH_TABLE **Hash_Table,
   int *Number, int *Max, SNGL_VECT **Elements, VECTOR aPoint);
 
+/* @CoppeliaSim@ */
+static void setup_mesh (MESH_SETUP *Setup, int Workers);
+#ifdef POV_THREADED_MESH_SETUP
+static void *setup_meshes (void *Pool);
+#endif
+
 
 
 /*****************************************************************************
@@ -158,6 +203,9 @@ static UV_HASH_TABLE **UV_Hash_Table; // GLOBAL VARIABLE
 
 static PRIORITY_QUEUE *Mesh_Queue; // GLOBAL VARIABLE
 
+/* @CoppeliaSim@ */
+static MESH_SETUP *Mesh_Setups = NULL; // GLOBAL VARIABLE
+
 
 
 /*****************************************************************************
@@ -1510,9 +1558,11 @@ static void get_triangle_bbox(MESH *Mesh, MESH_TRIANGLE *Triangle, BBOX *BBox)
 *
 *   Feb 1995 : Creation. (Derived from the bounding slab creation code)
 *
+*   @CoppeliaSim@ Up to Workers threads build the hierarchy.
+*
 ******************************************************************************/
 
-void Build_Mesh_BBox_Tree(MESH *Mesh)
+void Build_Mesh_BBox_Tree(MESH *Mesh, int Workers)
 {
   int i, nElem, maxelements;
   BBOX_TREE **Triangles;
@@ -1543,7 +1593,7 @@ void Build_Mesh_BBox_Tree(MESH *Mesh)
     get_triangle_bbox(Mesh, &Mesh->Data->Triangles[i], &Triangles[i]->BBox);
   }
 
-  Build_BBox_Tree(&Mesh->Data->Tree, nElem, Triangles, 0, NULL);
+  Build_BBox_Tree(&Mesh->Data->Tree, nElem, Triangles, 0, NULL, Workers);
 
   /* Get rid of the Triangles array. */
 
@@ -2561,6 +2611,460 @@ static void Mesh_UVCoord(VECTOR Result, OBJECT *Object, INTERSECTION *Inter)
 }
 
 
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Mesh_UV_Scale
+*
+* INPUT
+*
+*   Mesh     - Mesh object
+*   Triangle - Triangle
+*
+* OUTPUT
+*
+* RETURNS
+*
+*   DBL - UV units per world unit on the triangle, 0 if degenerate
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Ratio of the triangle's extent in UV space to its extent in world
+*   space, used to turn a ray footprint into a texture footprint.
+*
+* CHANGES
+*
+******************************************************************************/
+
+DBL Mesh_UV_Scale(MESH *Mesh, MESH_TRIANGLE *Triangle)
+{
+  DBL World_Area, UV_Area;
+  VECTOR P1, P2, P3, E1, E2, N;
+  UV_VECT UV1, UV2, UV3;
+
+  if (Mesh->Data->UVCoords == NULL)
+    return 0.0;
+
+  get_triangle_vertices(Mesh, Triangle, P1, P2, P3);
+  get_triangle_uvcoords(Mesh, Triangle, UV1, UV2, UV3);
+
+  if (Mesh->Trans != NULL)
+  {
+    MTransPoint(P1, P1, Mesh->Trans);
+    MTransPoint(P2, P2, Mesh->Trans);
+    MTransPoint(P3, P3, Mesh->Trans);
+  }
+
+  VSub(E1, P2, P1);
+  VSub(E2, P3, P1);
+  VCross(N, E1, E2);
+  VLength(World_Area, N);
+
+  UV_Area = fabs((UV2[U] - UV1[U]) * (UV3[V] - UV1[V]) - (UV3[U] - UV1[U]) * (UV2[V] - UV1[V]));
+
+  if ((World_Area < EPSILON * EPSILON) || (UV_Area <= 0.0))
+    return 0.0;
+
+  return sqrt(UV_Area / World_Area);
+}
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Defer_Mesh_Setup
+*
+* INPUT
+*
+*   Mesh                - Mesh object with its vertices, normals and UV
+*                         coordinates but no triangles yet
+*   Indices             - Vertex indices of the triangle corners, followed
+*                         by their normal and UV coordinate indices (-1 for
+*                         none), a vertex index of -1 skips a triangle
+*   Number_Of_Triangles - Number of triangles in Indices
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Leave the set up of the triangles and of the bounding box tree of a
+*   mesh to Complete_Mesh_Setup(), which does all meshes at once. The mesh
+*   bounding box has to be known already. Indices are freed when done.
+*
+* CHANGES
+*
+******************************************************************************/
+
+void Defer_Mesh_Setup(MESH *Mesh, int *Indices, long Number_Of_Triangles)
+{
+  MESH_SETUP *Setup;
+
+  Setup = (MESH_SETUP *)POV_MALLOC(sizeof(MESH_SETUP), "mesh setup");
+
+  /* A copy keeps the data even if the mesh is destroyed while parsing. */
+
+  Setup->Mesh = (MESH *)Copy_Object((OBJECT *)Mesh);
+  Setup->Indices = Indices;
+  Setup->Number_Of_Triangles = Number_Of_Triangles;
+
+  Setup->Next = Mesh_Setups;
+
+  Mesh_Setups = Setup;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Complete_Mesh_Setup
+*
+* INPUT
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Set up the meshes left by Defer_Mesh_Setup(). The meshes are shared by
+*   as many threads as there are render workers, if there are fewer meshes
+*   than workers the remaining workers help building the bounding box trees.
+*
+* CHANGES
+*
+******************************************************************************/
+
+void Complete_Mesh_Setup()
+{
+  int i, workers, threads;
+  MESH_SETUP *Setup;
+  MESH_SETUP_POOL Pool;
+
+  if (Mesh_Setups == NULL)
+  {
+    return;
+  }
+
+  Pool.Number_Of_Setups = 0;
+
+  for (Setup = Mesh_Setups; Setup != NULL; Setup = Setup->Next)
+  {
+    Pool.Number_Of_Setups++;
+  }
+
+  /* Meshes were added in front, do them in scene order. */
+
+  Pool.Setups = (MESH_SETUP **)POV_MALLOC(Pool.Number_Of_Setups * sizeof(MESH_SETUP *), "mesh setup");
+
+  i = Pool.Number_Of_Setups;
+
+  for (Setup = Mesh_Setups; Setup != NULL; Setup = Setup->Next)
+  {
+    Pool.Setups[--i] = Setup;
+  }
+
+  Pool.Next_Setup = 0;
+
+  workers = 1;
+
+#ifdef POV_THREADED_MESH_SETUP
+  workers = opts.Render_Workers;
+
+  if (workers <= 0)
+  {
+    workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  workers = max(1, workers);
+#endif
+
+  threads = min(workers, Pool.Number_Of_Setups);
+
+  Pool.Workers = workers / threads;
+
+#ifdef POV_THREADED_MESH_SETUP
+  if (threads > 1)
+  {
+    pthread_t *Threads;
+    bool *Started;
+
+    pthread_mutex_init(&Pool.Lock, NULL);
+
+    Threads = (pthread_t *)POV_MALLOC(threads * sizeof(pthread_t), "mesh setup threads");
+    Started = (bool *)POV_MALLOC(threads * sizeof(bool), "mesh setup threads");
+
+    for (i = 1; i < threads; i++)
+    {
+      Started[i] = (pthread_create(&Threads[i], NULL, setup_meshes, &Pool) == 0);
+    }
+
+    /* This thread helps, and finishes if no other thread could be started. */
+
+    setup_meshes(&Pool);
+
+    for (i = 1; i < threads; i++)
+    {
+      if (Started[i])
+      {
+        pthread_join(Threads[i], NULL);
+      }
+    }
+
+    POV_FREE(Started);
+    POV_FREE(Threads);
+
+    pthread_mutex_destroy(&Pool.Lock);
+  }
+  else
+#endif
+  {
+    for (i = 0; i < Pool.Number_Of_Setups; i++)
+    {
+      setup_mesh(Pool.Setups[i], Pool.Workers);
+    }
+  }
+
+  POV_FREE(Pool.Setups);
+
+  Discard_Mesh_Setup();
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Discard_Mesh_Setup
+*
+* INPUT
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Drop the meshes left by Defer_Mesh_Setup(), after they have been set up
+*   or if parsing stopped.
+*
+* CHANGES
+*
+******************************************************************************/
+
+void Discard_Mesh_Setup()
+{
+  MESH_SETUP *Setup;
+
+  while (Mesh_Setups != NULL)
+  {
+    Setup = Mesh_Setups;
+
+    Mesh_Setups = Setup->Next;
+
+    if (Setup->Indices != NULL)
+    {
+      POV_FREE(Setup->Indices);
+    }
+
+    Destroy_Object((OBJECT *)Setup->Mesh);
+
+    POV_FREE(Setup);
+  }
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   setup_mesh
+*
+* INPUT
+*
+*   Setup   - Mesh to set up
+*   Workers - Number of threads building the bounding box tree
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Set up the triangles of a mesh, smoothing those whose normals differ,
+*   and build its bounding box tree. Nothing shared with other meshes is
+*   changed, so several meshes can be set up at once.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void setup_mesh(MESH_SETUP *Setup, int Workers)
+{
+  long i, n, number_of_uvcoords;
+  int smooth;
+  const int *PI, *NI, *UI;
+  DBL l1, l2;
+  VECTOR D1, D2, P1, P2, P3, N;
+  MESH_DATA *Data;
+  MESH_TRIANGLE *Triangle;
+
+  Data = Setup->Mesh->Data;
+
+  n = Setup->Number_Of_Triangles;
+
+  /* Face normals follow the given normals, the last UV coordinate is <0,0>. */
+
+  number_of_uvcoords = Data->Number_Of_UVCoords - 1;
+
+  for (i = 0; i < n; i++)
+  {
+    PI = Setup->Indices + 3*i;
+    NI = Setup->Indices + 3*(n + i);
+    UI = Setup->Indices + 3*(2*n + i);
+
+    if (PI[0] < 0)
+    {
+      continue;
+    }
+
+    Assign_Vector(P1, Data->Vertices[PI[0]]);
+    Assign_Vector(P2, Data->Vertices[PI[1]]);
+    Assign_Vector(P3, Data->Vertices[PI[2]]);
+
+    Triangle = &Data->Triangles[Data->Number_Of_Triangles];
+
+    Init_Mesh_Triangle(Triangle);
+
+    Triangle->P1 = PI[0];
+    Triangle->P2 = PI[1];
+    Triangle->P3 = PI[2];
+
+    Triangle->UV1 = (UI[0] >= 0 ? UI[0] : number_of_uvcoords);
+    Triangle->UV2 = (UI[1] >= 0 ? UI[1] : number_of_uvcoords);
+    Triangle->UV3 = (UI[2] >= 0 ? UI[2] : number_of_uvcoords);
+
+    /* Smooth triangle only if its normals differ. */
+
+    smooth = false;
+
+    if ((NI[0] >= 0) && (NI[1] >= 0) && (NI[2] >= 0))
+    {
+      VSub(D1, Data->Normals[NI[0]], Data->Normals[NI[1]]);
+      VSub(D2, Data->Normals[NI[0]], Data->Normals[NI[2]]);
+
+      VDot(l1, D1, D1);
+      VDot(l2, D2, D2);
+
+      smooth = ((fabs(l1) > EPSILON) || (fabs(l2) > EPSILON));
+    }
+
+    if (smooth)
+    {
+      Triangle->N1 = NI[0];
+      Triangle->N2 = NI[1];
+      Triangle->N3 = NI[2];
+    }
+
+    Compute_Mesh_Triangle(Triangle, smooth, P1, P2, P3, N);
+
+    Assign_Vector(Data->Normals[Data->Number_Of_Normals], N);
+    Triangle->Normal_Ind = Data->Number_Of_Normals++;
+
+    Data->Number_Of_Triangles++;
+  }
+
+  POV_FREE(Setup->Indices);
+
+  Setup->Indices = NULL;
+
+  Build_Mesh_BBox_Tree(Setup->Mesh, Workers);
+}
+
+
+
+#ifdef POV_THREADED_MESH_SETUP
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   setup_meshes
+*
+* INPUT
+*
+*   Pool - Meshes to set up
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Thread entry point setting up meshes of the pool until none is left.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void *setup_meshes(void *Pool)
+{
+  MESH_SETUP_POOL *P = (MESH_SETUP_POOL *)Pool;
+  int i;
+
+  while (true)
+  {
+    pthread_mutex_lock(&P->Lock);
+
+    i = P->Next_Setup++;
+
+    pthread_mutex_unlock(&P->Lock);
+
+    if (i >= P->Number_Of_Setups)
+    {
+      break;
+    }
+
+    setup_mesh(P->Setups[i], P->Workers);
+  }
+
+  return NULL;
+}
+
+#endif
+
+
 /*****************************************************************************
 *
 * FUNCTION
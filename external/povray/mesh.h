@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 
 #ifndef MESH_H
 #define MESH_H
@@ -108,7 +114,7 @@ MESH *Create_Mesh (void);
 int Compute_Mesh_Triangle (MESH_TRIANGLE *Triangle, int Smooth, VECTOR P1, VECTOR P2, VECTOR P3, VECTOR S_Normal);
 void Compute_Mesh_BBox (MESH *Mesh);
 void Init_Mesh_Triangle (MESH_TRIANGLE *Triangle);
-void Build_Mesh_BBox_Tree (MESH *Mesh);
+void Build_Mesh_BBox_Tree (MESH *Mesh, int Workers); /* @CoppeliaSim@ */
 void Test_Mesh_Opacity (MESH *Blob);
 
 void Create_Mesh_Hash_Tables (void);
@@ -121,6 +127,10 @@ int Mesh_Degenerate (VECTOR P1, VECTOR P2, VECTOR P3);
 void Initialize_Mesh_Code (void);
 void Deinitialize_Mesh_Code (void);
 int Mesh_Interpolate(VECTOR Weights, VECTOR IPoint, MESH *m, MESH_TRIANGLE *Triangle);
+DBL Mesh_UV_Scale (MESH *Mesh, MESH_TRIANGLE *Triangle); /* @CoppeliaSim@ */
+void Defer_Mesh_Setup (MESH *Mesh, int *Indices, long Number_Of_Triangles); /* @CoppeliaSim@ */
+void Complete_Mesh_Setup (void); /* @CoppeliaSim@ */
+void Discard_Mesh_Setup (void); /* @CoppeliaSim@ */
 
 END_POV_NAMESPACE
 
@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 #include "frame.h"
 #include "povray.h"
 #include "vector.h"
@@ -326,6 +332,10 @@ void Translate_Object (OBJECT *Object, VECTOR Vector, TRANSFORM *Trans)
   /* NK 1998 added if */
   if (!Test_Flag(Object, UV_FLAG))
   {
+    /* @CoppeliaSim@ */
+    Object->Texture = Unshare_Textures(Object->Texture);
+    Object->Interior_Texture = Unshare_Textures(Object->Interior_Texture);
+
     Transform_Textures(Object->Texture, Trans);
     Transform_Textures(Object->Interior_Texture, Trans);
   }
@@ -392,6 +402,10 @@ void Rotate_Object (OBJECT *Object, VECTOR Vector, TRANSFORM *Trans)
   /* NK 1998 added if */
   if (!Test_Flag(Object, UV_FLAG))
   {
+    /* @CoppeliaSim@ */
+    Object->Texture = Unshare_Textures(Object->Texture);
+    Object->Interior_Texture = Unshare_Textures(Object->Interior_Texture);
+
     Transform_Textures(Object->Texture, Trans);
     Transform_Textures(Object->Interior_Texture, Trans);
   }
@@ -458,6 +472,10 @@ void Scale_Object (OBJECT *Object, VECTOR Vector, TRANSFORM *Trans)
   /* NK 1998 added if */
   if (!Test_Flag(Object, UV_FLAG))
   {
+    /* @CoppeliaSim@ */
+    Object->Texture = Unshare_Textures(Object->Texture);
+    Object->Interior_Texture = Unshare_Textures(Object->Interior_Texture);
+
     Transform_Textures(Object->Texture, Trans);
     Transform_Textures(Object->Interior_Texture, Trans);
   }
@@ -524,6 +542,10 @@ void Transform_Object (OBJECT *Object, TRANSFORM *Trans)
   /* NK 1998 added if */
   if (!Test_Flag(Object, UV_FLAG))
   {
+    /* @CoppeliaSim@ */
+    Object->Texture = Unshare_Textures(Object->Texture);
+    Object->Interior_Texture = Unshare_Textures(Object->Interior_Texture);
+
     Transform_Textures(Object->Texture, Trans);
     Transform_Textures(Object->Interior_Texture, Trans);
   }
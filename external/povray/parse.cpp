@@ -175,6 +175,7 @@ static OBJECT *Parse_Superellipsoid (void);
 static OBJECT *Parse_Torus (void);
 static OBJECT *Parse_Triangle (void);
 static OBJECT *Parse_Mesh (void);
+static int *Parse_Mesh_Block (MESH *Object, int *Number_Of_Triangles); /* @CoppeliaSim@ */
 static OBJECT *Parse_Mesh2 (void);
 static TEXTURE *Parse_Mesh_Texture (TEXTURE **t2, TEXTURE **t3);
 static OBJECT *Parse_TrueType (void);
@@ -293,6 +294,9 @@ void Parse()
 
     Parse_Frame ();
 
+    /* @CoppeliaSim@ */
+    Complete_Mesh_Setup();
+
     Stage = STAGE_CLEANUP_PARSE;
 
     Post_Media(Frame.Atmosphere);
@@ -401,6 +405,9 @@ void Destroy_Frame()
       return ;
     Destroying_Frame = true ;
 
+    /* @CoppeliaSim@ */
+    Discard_Mesh_Setup();
+
     Destroy_Camera (Frame.Camera);
     Frame.Camera=NULL;
 
@@ -1061,7 +1068,7 @@ static OBJECT *Parse_Box ()
 static void Parse_Camera (CAMERA **Camera_Ptr)
 {
     int i;
-    DBL Direction_Length = 1.0, Up_Length, Right_Length, Handedness;
+    DBL Direction_Length = 1.0, Right_Length;
     DBL k1, k2, k3;
     VECTOR tempv;
     MATRIX Local_Matrix;
@@ -1436,49 +1443,10 @@ static void Parse_Camera (CAMERA **Camera_Ptr)
         if (New->Look_At[X] != HUGE_VAL)
         {
             VLength (Direction_Length, New->Direction);
-            VLength (Up_Length,        New->Up);
-            VLength (Right_Length,     New->Right);
-            VCross  (tempv,            New->Up, New->Direction);
-            VDot    (Handedness,       tempv,   New->Right);
-
-            Assign_Vector(New->Direction, New->Look_At);
 
-            VSub          (New->Direction, New->Direction, New->Location);
-
-            // Check for zero length direction vector.
-            if (VSumSqr(New->Direction) < EPSILON)
+            // Check for zero length direction vector. /* @CoppeliaSim@ */
+            if (! Point_Camera (New))
                 Error("Camera location and look_at point must be different.");
-
-            VNormalize (New->Direction, New->Direction);
-
-            // Save Right vector
-            Assign_Vector (tempv, New->Right);
-
-            VCross        (New->Right, New->Sky, New->Direction);
-
-            // Avoid DOMAIN error (from Terry Kanakis)
-            if((fabs(New->Right[X]) < EPSILON) &&
-               (fabs(New->Right[Y]) < EPSILON) &&
-               (fabs(New->Right[Z]) < EPSILON))
-            {
-                // Restore Right vector
-                Assign_Vector (New->Right, tempv);
-            }
-
-            VNormalize (New->Right,     New->Right);
-            VCross     (New->Up,        New->Direction, New->Right);
-            VScale     (New->Direction, New->Direction, Direction_Length);
-
-            if (Handedness > 0.0)
-            {
-                VScaleEq (New->Right, Right_Length);
-            }
-            else
-            {
-                VScaleEq (New->Right, -Right_Length);
-            }
-
-            VScaleEq(New->Up, Up_Length);
         }
         else
             Assign_Vector(New->Look_At, old_look_at); // restore default look_at
@@ -1610,50 +1578,12 @@ static void Parse_Camera (CAMERA **Camera_Ptr)
 
             CASE (LOOK_AT_TOKEN)
                 VLength (Direction_Length, New->Direction);
-                VLength (Up_Length,        New->Up);
-                VLength (Right_Length,     New->Right);
-                VCross  (tempv,            New->Up, New->Direction);
-                VDot    (Handedness,       tempv,   New->Right);
-
-                Parse_Vector (New->Direction);
-                Assign_Vector(New->Look_At, New->Direction);
 
-                VSub          (New->Direction, New->Direction, New->Location);
+                Parse_Vector (New->Look_At);
 
-                // Check for zero length direction vector.
-                if (VSumSqr(New->Direction) < EPSILON)
+                // Check for zero length direction vector. /* @CoppeliaSim@ */
+                if (! Point_Camera (New))
                     Error("Camera location and look_at point must be different.");
-
-                VNormalize (New->Direction, New->Direction);
-
-                // Save Right vector
-                Assign_Vector (tempv, New->Right);
-
-                VCross        (New->Right, New->Sky, New->Direction);
-
-                // Avoid DOMAIN error (from Terry Kanakis)
-                if((fabs(New->Right[X]) < EPSILON) &&
-                   (fabs(New->Right[Y]) < EPSILON) &&
-                   (fabs(New->Right[Z]) < EPSILON))
-                {
-                    // Restore Right vector
-                    Assign_Vector (New->Right, tempv);
-                }
-
-                VNormalize (New->Right,     New->Right);
-                VCross     (New->Up,        New->Direction, New->Right);
-                VScale     (New->Direction, New->Direction, Direction_Length);
-
-                if (Handedness > 0.0)
-                {
-                    VScaleEq (New->Right, Right_Length);
-                }
-                else
-                {
-                    VScaleEq (New->Right, -Right_Length);
-                }
-
-                VScaleEq(New->Up, Up_Length);
             END_CASE
 
             CASE (TRANSLATE_TOKEN)
@@ -1839,6 +1769,26 @@ bool Parse_Camera_Mods(CAMERA *New)
             Parse_Vector(New->Focal_Point);
         END_CASE
 
+        ///////////////////////////////////////////////////////////////////////////////
+        //                                                                           //
+        // @CoppeliaSim@                                                                   //
+        //                                                                           //
+        // Near and far clipping distances along the viewing direction               //
+        //                                                                           //
+        ///////////////////////////////////////////////////////////////////////////////
+
+        CASE (NEAR_DISTANCE_TOKEN)
+            New->Near_Distance = Parse_Float();
+            if (New->Near_Distance < 0.0)
+                Error("Near clipping distance cannot be negative.");
+        END_CASE
+
+        CASE (FAR_DISTANCE_TOKEN)
+            New->Far_Distance = Parse_Float();
+            if (New->Far_Distance < 0.0)
+                Error("Far clipping distance cannot be negative.");
+        END_CASE
+
         OTHERWISE
             UNGET
             return false;
@@ -3249,6 +3199,7 @@ static OBJECT *Parse_Mesh()
   VECTOR Inside_Vect;
   TEXTURE *t2, *t3;
   bool foundZeroNormal=false;
+  int *Indices; /* @CoppeliaSim@ */
 
   Make_Vector(Inside_Vect, 0, 0, 0);
 
@@ -3263,6 +3214,33 @@ static OBJECT *Parse_Mesh()
 
   Object = Create_Mesh();
 
+  ///////////////////////////////////////////////////////////////////////////////
+  //                                                                           //
+  // @CoppeliaSim@                                                                   //
+  //                                                                           //
+  // An indexed block holds the whole mesh, read without hashing. Its          //
+  // triangles and bounding box tree are set up with those of the other        //
+  // meshes once the scene is parsed.                                          //
+  //                                                                           //
+  ///////////////////////////////////////////////////////////////////////////////
+
+  EXPECT
+    CASE(INDEXED_BLOCK_TOKEN)
+      Indices = Parse_Mesh_Block(Object, &number_of_triangles);
+
+      Parse_Object_Mods((OBJECT *)Object);
+
+      Defer_Mesh_Setup(Object, Indices, number_of_triangles);
+
+      return((OBJECT *)Object);
+    END_CASE
+
+    OTHERWISE
+      UNGET
+      EXIT
+    END_CASE
+  END_EXPECT
+
   /* Allocate temporary normals, textures, triangles and vertices. */
 
   max_normals = 256;
@@ -3661,11 +3639,225 @@ static OBJECT *Parse_Mesh()
 
   /* Create bounding box tree. */
 
-  Build_Mesh_BBox_Tree(Object);
+  Build_Mesh_BBox_Tree(Object, 1);
 
   return((OBJECT *)Object);
 }
 
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Parse_Mesh_Block
+*
+* INPUT
+*
+*   Object - Mesh to fill in
+*
+* OUTPUT
+*
+*   Object, Number_Of_Triangles
+*
+* RETURNS
+*
+*   int * - Corner indices of the triangles to pass to Defer_Mesh_Setup()
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Read an indexed mesh block in binary format: the numbers of vertices,
+*   normals, UV coordinates and triangles, followed by the vertex, normal and
+*   UV coordinate arrays and then by the vertex, normal and UV coordinate
+*   indices of the triangle corners (normal and UV coordinate indices only
+*   if there are normals or UV coordinates, -1 for none). Each array is read
+*   in one go straight into the mesh data, as vertices are already shared
+*   there is no need to hash them.
+*
+*   Only what may raise errors or warnings is done here, along with the
+*   bounding box of the mesh: the indices are checked and degenerate
+*   triangles are marked. The triangles themselves are set up later.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static int *Parse_Mesh_Block(MESH *Object, int *Number_Of_Triangles)
+{
+  int i, j, valid_triangles;
+  int counts[4];
+  int number_of_normals, number_of_triangles, number_of_vertices, number_of_uvcoords;
+  int *Indices, *PI, *NI, *UI;
+  float *UV_Buffer;
+  DBL l1;
+  VECTOR P1, P2, P3, N, mins, maxs;
+  MESH_DATA *Data;
+  bool foundZeroNormal = false;
+
+  Parse_Begin();
+
+  if (!parse_binary(counts, sizeof counts))
+  {
+    Error("Cannot read indexed mesh block.");
+  }
+
+  number_of_vertices = counts[0];
+  number_of_normals = counts[1];
+  number_of_uvcoords = counts[2];
+  number_of_triangles = counts[3];
+
+  if ((number_of_vertices < 0) || (number_of_normals < 0) || (number_of_uvcoords < 0) || (number_of_triangles < 0) ||
+      (number_of_vertices > INT_MAX / (int)sizeof(SNGL_VECT)) || (number_of_normals > INT_MAX / (int)sizeof(SNGL_VECT) - number_of_triangles) ||
+      (number_of_uvcoords > INT_MAX / (int)sizeof(UV_VECT) - 1) || (number_of_triangles > INT_MAX / (9 * (int)sizeof(int))))
+  {
+    Error("Invalid indexed mesh block size.");
+  }
+
+  /* Init triangle mesh data, face normals follow the given normals. */
+
+  Data = Object->Data = (MESH_DATA *)POV_MALLOC(sizeof(MESH_DATA), "triangle mesh data");
+
+  Data->References = 1;
+  Data->Tree = NULL;
+
+  Object->has_inside_vector = false;
+  Object->Number_Of_Textures = 0;
+  Object->Textures = NULL;
+
+  Data->Number_Of_Vertices = number_of_vertices;
+  Data->Number_Of_UVCoords = number_of_uvcoords + 1;
+  Data->Number_Of_Normals = number_of_normals;
+  Data->Number_Of_Triangles = 0;
+
+  Data->Vertices = (SNGL_VECT *)POV_MALLOC((number_of_vertices + 1)*sizeof(SNGL_VECT), "triangle mesh data");
+  Data->Normals = (SNGL_VECT *)POV_MALLOC((number_of_normals + number_of_triangles + 1)*sizeof(SNGL_VECT), "triangle mesh data");
+  Data->UVCoords = (UV_VECT *)POV_MALLOC((number_of_uvcoords + 1)*sizeof(UV_VECT), "triangle mesh data");
+  Data->Triangles = (MESH_TRIANGLE *)POV_MALLOC((number_of_triangles + 1)*sizeof(MESH_TRIANGLE), "triangle mesh data");
+
+  /* Vertex, normal and UV coordinate indices follow each other. */
+
+  Indices = (int *)POV_MALLOC((9*number_of_triangles + 1)*sizeof(int), "temporary triangle mesh data");
+  UV_Buffer = (float *)POV_MALLOC((2*number_of_uvcoords + 1)*sizeof(float), "temporary triangle mesh data");
+
+  PI = Indices;
+  NI = Indices + 3*number_of_triangles;
+  UI = Indices + 6*number_of_triangles;
+
+  /* Read the arrays. */
+
+  if (!parse_binary(Data->Vertices, number_of_vertices*sizeof(SNGL_VECT)) ||
+      !parse_binary(Data->Normals, number_of_normals*sizeof(SNGL_VECT)) ||
+      !parse_binary(UV_Buffer, 2*number_of_uvcoords*sizeof(float)) ||
+      !parse_binary(PI, 3*number_of_triangles*sizeof(int)) ||
+      ((number_of_normals > 0) && !parse_binary(NI, 3*number_of_triangles*sizeof(int))) ||
+      ((number_of_uvcoords > 0) && !parse_binary(UI, 3*number_of_triangles*sizeof(int))))
+  {
+    Error("Cannot read indexed mesh block.");
+  }
+
+  for (i = 0; i < 3*number_of_triangles; i++)
+  {
+    if (number_of_normals == 0)
+    {
+      NI[i] = -1;
+    }
+
+    if (number_of_uvcoords == 0)
+    {
+      UI[i] = -1;
+    }
+  }
+
+  /* Normalize normals, UV coordinates default to <0,0> like in triangles. */
+
+  for (i = 0; i < number_of_normals; i++)
+  {
+    Assign_Vector(N, Data->Normals[i]);
+    VLength(l1, N);
+
+    if (l1 < EPSILON)
+    {
+      Make_Vector(N, 1.0, 0.0, 0.0);  // make it nonzero
+      if(!foundZeroNormal)
+        Warning(0,"Normal vector in mesh cannot be zero - changing it to <1,0,0>.");
+      foundZeroNormal = true;
+    }
+    else
+      VInverseScaleEq(N, l1);
+
+    Assign_Vector(Data->Normals[i], N);
+  }
+
+  for (i = 0; i < number_of_uvcoords; i++)
+  {
+    Data->UVCoords[i][U] = UV_Buffer[2*i];
+    Data->UVCoords[i][V] = UV_Buffer[2*i+1];
+  }
+
+  Data->UVCoords[number_of_uvcoords][U] = 0.0;
+  Data->UVCoords[number_of_uvcoords][V] = 0.0;
+
+  POV_FREE(UV_Buffer);
+
+  /* Check the triangles, marking degenerate ones, and bound the others. */
+
+  Make_Vector(mins, BOUND_HUGE, BOUND_HUGE, BOUND_HUGE);
+  Make_Vector(maxs, -BOUND_HUGE, -BOUND_HUGE, -BOUND_HUGE);
+
+  valid_triangles = 0;
+
+  for (i = 0; i < 3*number_of_triangles; i += 3)
+  {
+    for (j = i; j < i + 3; j++)
+    {
+      if ((PI[j] < 0) || (PI[j] >= number_of_vertices) ||
+          (NI[j] < -1) || (NI[j] >= number_of_normals) || (UI[j] < -1) || (UI[j] >= number_of_uvcoords))
+      {
+        Error("Index out of range in indexed mesh block.");
+      }
+    }
+
+    Assign_Vector(P1, Data->Vertices[PI[i]]);
+    Assign_Vector(P2, Data->Vertices[PI[i+1]]);
+    Assign_Vector(P3, Data->Vertices[PI[i+2]]);
+
+    if (Mesh_Degenerate(P1, P2, P3))
+    {
+      PI[i] = -1;
+
+      continue;
+    }
+
+    mins[X] = min(mins[X], min3(P1[X], P2[X], P3[X]));
+    mins[Y] = min(mins[Y], min3(P1[Y], P2[Y], P3[Y]));
+    mins[Z] = min(mins[Z], min3(P1[Z], P2[Z], P3[Z]));
+
+    maxs[X] = max(maxs[X], max3(P1[X], P2[X], P3[X]));
+    maxs[Y] = max(maxs[Y], max3(P1[Y], P2[Y], P3[Y]));
+    maxs[Z] = max(maxs[Z], max3(P1[Z], P2[Z], P3[Z]));
+
+    valid_triangles++;
+  }
+
+  if (valid_triangles == 0)
+  {
+    POV_FREE(Indices);
+
+    Error("No triangles in triangle mesh.");
+  }
+
+  Make_BBox_from_min_max(Object->BBox, mins, maxs);
+
+  Parse_End();
+
+  *Number_Of_Triangles = number_of_triangles;
+
+  return Indices;
+}
+
+
 /*****************************************************************************
 *
 * FUNCTION
@@ -4234,7 +4426,7 @@ static OBJECT *Parse_Mesh2()
   Parse_Object_Mods((OBJECT *)Object);
 
   /* Create bounding box tree. */
-  Build_Mesh_BBox_Tree(Object);
+  Build_Mesh_BBox_Tree(Object, 1);
 
 /*
   Render_Info("Mesh2: %ld bytes: %ld vertices, %ld normals, %ld textures, %ld triangles\n",
@@ -8344,6 +8536,16 @@ void Link_Textures (TEXTURE **Old_Textures, TEXTURE *New_Textures)
    if (New_Textures == NULL)
      return;
 
+   /* @CoppeliaSim@ */
+   /* Layering modifies the new texture, which may be a shared identifier. */
+   if ((*Old_Textures != NULL) || (opts.Language_Version <= 310))
+     New_Textures = Unshare_Textures(New_Textures);
+
+   /* @CoppeliaSim@ */
+   /* The old textures become layers under the new ones: the new head owns */
+   /* them, so they are destroyed and transformed with it.                 */
+   *Old_Textures = Unshare_Textures(*Old_Textures);
+
     ///////////////////////////////////////////////////////////////////////////////
     //                                                                           //
     // @CoppeliaSim@                                                                   //
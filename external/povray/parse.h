@@ -30,6 +30,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 #ifndef PARSE_H
 #define PARSE_H
 
@@ -624,6 +630,10 @@ enum TOKEN_IDS
   NOISE_GENERATOR_TOKEN,
   JULIA_TOKEN,
   MAGNET_TOKEN,
+  /* @CoppeliaSim@ */
+  NEAR_DISTANCE_TOKEN,
+  FAR_DISTANCE_TOKEN,
+  INDEXED_BLOCK_TOKEN,
   LAST_TOKEN
 #ifdef GLOBAL_PHOTONS
   GLOBAL_TOKEN,
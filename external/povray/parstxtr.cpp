@@ -2190,7 +2190,19 @@ TEXTURE *Parse_Texture ()
 
    EXPECT               /* First allow a texture identifier */
      CASE (TEXTURE_ID_TOKEN)
-       Texture = Copy_Textures((TEXTURE *) Token.Data);
+       Texture = (TEXTURE *) Token.Data;
+
+       /* @CoppeliaSim@ */
+       /* Share an unmodified texture identifier instead of copying it. */
+       Get_Token();
+       Unget_Token();
+
+       if (Token.Token_Id == RIGHT_CURLY_TOKEN)
+       {
+         return(Copy_Texture_Pointer(Texture));
+       }
+
+       Texture = Copy_Textures(Texture);
        Modified_Pnf = true;
        EXIT
      END_CASE
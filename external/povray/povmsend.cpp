@@ -1033,7 +1033,7 @@ void Send_InitInfo()
 *
 * CHANGES
 *
-*   -
+*   @CoppeliaSim@ : Nothing is sent from forked worker processes.
 *
 ******************************************************************************/
 
@@ -1042,6 +1042,11 @@ int Send_Progress(const char *statusString, int progressState)
     POVMSObject msg;
     int err = kNoErr;
 
+    /* @CoppeliaSim@ */
+    // Forked worker processes never call into the host application
+    if(Render_Worker_Process)
+        return kNoErr;
+
     Previous_t = 0;
 
     if(err == kNoErr)
@@ -1088,7 +1093,7 @@ int Send_Progress(const char *statusString, int progressState)
 *
 * CHANGES
 *
-*   -
+*   @CoppeliaSim@ : Nothing is sent from forked worker processes.
 *
 ******************************************************************************/
 
@@ -1098,6 +1103,11 @@ int Send_ProgressUpdate(int progressState, int t)
     int err = kNoErr;
     DBL time_dif;
 
+    /* @CoppeliaSim@ */
+    // Forked worker processes never call into the host application
+    if(Render_Worker_Process)
+        return kNoErr;
+
     STOP_TIME
     time_dif = TIME_ELAPSED
 
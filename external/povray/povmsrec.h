@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 
 #ifndef POVMSRECEIVE_H
 #define POVMSRECEIVE_H
@@ -50,6 +56,9 @@ BEGIN_POV_NAMESPACE
 * Global variables
 ******************************************************************************/
 
+/* @CoppeliaSim@ */
+extern const int Quality_Values[12];
+
 
 /*****************************************************************************
 * Global functions
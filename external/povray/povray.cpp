@@ -44,9 +44,11 @@
 #include <algorithm>
 
 #include "frame.h"
+#include "vector.h"
 #include "bezier.h"
 #include "blob.h"
 #include "bbox.h"
+#include "camera.h"
 #include "cones.h"
 #include "csg.h"
 #include "discs.h"
@@ -100,6 +102,11 @@
 #include "rendctrl.h"
 #include "platformbase.h"
 
+/* @CoppeliaSim@ */
+#if defined(__linux)
+#include <unistd.h>
+#endif
+
 #if(USE_LOCAL_POVMS_OUTPUT == 1)
     #include "defaultrenderfrontend.h"
     #include "defaultplatformbase.h"
@@ -160,6 +167,23 @@ END_POV_NAMESPACE
 // Used for POVMS message receiving
 POVMSContext POVMS_Render_Context = NULL; // GLOBAL VARIABLE
 
+// Ray counts of the current render (@CoppeliaSim@)
+RENDER_STATISTICS Render_Statistics; // GLOBAL VARIABLE
+
+// Regions traced by the current render, given by the caller for the duration of the call (@CoppeliaSim@)
+int Number_Of_Render_Regions = 0; // GLOBAL VARIABLE
+const RENDER_REGION* Render_Regions = NULL; // GLOBAL VARIABLE
+
+// Told about finished parts of the image by the current render (@CoppeliaSim@)
+RENDER_PROGRESS_CALLBACK Render_Progress_Callback = NULL; // GLOBAL VARIABLE
+void* Render_Progress_Data = NULL; // GLOBAL VARIABLE
+
+// Set in forked worker processes, which must not run the exit handlers of the host application (@CoppeliaSim@)
+int Render_Worker_Process = false; // GLOBAL VARIABLE
+
+// Whether a parsed scene is kept for povray_render_view (@CoppeliaSim@)
+static bool Scene_Retained = false; // GLOBAL VARIABLE
+
 // Used for POVMS message sending
 #if(USE_LOCAL_POVMS_OUTPUT == 1)
 POVMSContext POVMS_Output_Context = NULL; // GLOBAL VARIABLE
@@ -177,13 +201,73 @@ PlatformBase *POV_BASE_NAMESPACE::PlatformBase::self = NULL; // GLOBAL VARIABLE
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-int povray_render_scene (const char* file_name, unsigned char* target_buffer, int nx, int ny, int flg)
+void povray_init_settings (RENDER_SETTINGS* settings)
+{
+    settings->Backend = RENDER_BACKEND_SERIAL;
+    settings->Workers = 0;
+    settings->Quality = 9;
+    settings->Antialias = false;
+    settings->Antialias_Threshold = 0.3;
+    settings->Antialias_Depth = 3;
+    settings->Rasterize = false;
+    settings->Roulette_Weight = 0.0;
+    settings->Ray_Budget = 0.0;
+    settings->Number_Of_Regions = 0;
+    settings->Regions = NULL;
+    settings->Region_Fill = RENDER_FILL_BACKGROUND;
+    settings->Progress_Callback = NULL;
+    settings->Progress_Data = NULL;
+}
+
+static void apply_render_settings (const RENDER_SETTINGS* settings)
+{
+    opts.Render_Backend = settings->Backend;
+    opts.Render_Workers = settings->Workers;
+
+    if ((settings->Quality >= 0) && (settings->Quality <= 9))
+    {
+        opts.Quality = settings->Quality;
+        opts.Quality_Flags = Quality_Values[opts.Quality];
+    }
+
+    if (settings->Antialias)
+        opts.Options |= ANTIALIAS;
+    else
+        opts.Options &= ~ANTIALIAS;
+
+    opts.Antialias_Threshold = settings->Antialias_Threshold;
+    opts.AntialiasDepth = max(1, min(settings->Antialias_Depth, 9));
+
+    if (settings->Rasterize)
+        opts.Options |= USE_RASTER_BUFFER;
+    else
+        opts.Options &= ~USE_RASTER_BUFFER;
+
+    opts.Roulette_Weight = max(0.0, min(settings->Roulette_Weight, 1.0));
+    opts.Ray_Budget = max(0.0, settings->Ray_Budget);
+
+    if (settings->Regions)
+    {
+        Number_Of_Render_Regions = max(0, settings->Number_Of_Regions);
+        Render_Regions = settings->Regions;
+    }
+
+    opts.Region_Fill = settings->Region_Fill;
+
+    Render_Progress_Callback = settings->Progress_Callback;
+    Render_Progress_Data = settings->Progress_Data;
+}
+
+int povray_render_scene (const char* file_name, unsigned char* target_buffer, int nx, int ny, const RENDER_SETTINGS* settings)
 {
     DefaultPlatformBase platformbase;
 
     if (! file_name || ! target_buffer || ! nx || ! ny)
         return 0;
 
+    // A scene kept from an earlier call is replaced
+    povray_release_scene();
+
     // Init
     povray_init();
     init_vars();
@@ -194,6 +278,15 @@ int povray_render_scene (const char* file_name, unsigned char* target_buffer, in
     Frame.Screen_Height = ny;
     opts.Output_File_Type = NO_FILE;
     opts.Options = (opts.Options | DISPLAY) & ~DISKWRITE & ~USE_VISTA_BUFFER;
+    Number_Of_Render_Regions = 0;
+    Render_Progress_Callback = NULL;
+
+    if (settings)
+    {
+        apply_render_settings(settings);
+
+        opts.Retain_Scene = (settings->Retain_Scene != 0);
+    }
 
     // Strip path and extension off input name to create scene name
     fix_up_scene_name();
@@ -205,12 +298,102 @@ int povray_render_scene (const char* file_name, unsigned char* target_buffer, in
     // Enter the frame loop
     FrameLoop();
 
-    // Finish
-    povray_terminate();
+    // The regions and the progress callback belong to the caller
+    Number_Of_Render_Regions = 0;
+    Render_Regions = NULL;
+    Render_Progress_Callback = NULL;
+
+    // Keep the scene parsed for other views, or finish
+    if (opts.Retain_Scene)
+        Scene_Retained = true;
+    else
+        povray_terminate();
 
     return 1;
 }
 
+// Render the scene kept by the last povray_render_scene from another camera,
+// possibly at another size; returns 0 if no scene is kept
+int povray_render_view (const RENDER_CAMERA* camera, unsigned char* target_buffer, int nx, int ny, const RENDER_SETTINGS* settings)
+{
+    CAMERA* Camera = Frame.Camera;
+
+    if (! Scene_Retained || ! camera || ! target_buffer || (nx <= 0) || (ny <= 0))
+        return 0;
+
+    opts.Preview_RefCon = target_buffer;
+    Frame.Screen_Width = nx;
+    Frame.Screen_Height = ny;
+    Number_Of_Render_Regions = 0;
+    Render_Progress_Callback = NULL;
+
+    if (settings)
+        apply_render_settings(settings);
+
+    // Set the camera as Parse_Camera does: look_at last, then focal_point
+    Camera->Type = (camera->Orthographic ? ORTHOGRAPHIC_CAMERA : PERSPECTIVE_CAMERA);
+    Make_Vector(Camera->Location, camera->Location[X], camera->Location[Y], camera->Location[Z]);
+    Make_Vector(Camera->Direction, camera->Direction[X], camera->Direction[Y], camera->Direction[Z]);
+    Make_Vector(Camera->Right, camera->Right[X], camera->Right[Y], camera->Right[Z]);
+    Make_Vector(Camera->Up, camera->Up[X], camera->Up[Y], camera->Up[Z]);
+    Make_Vector(Camera->Sky, camera->Sky[X], camera->Sky[Y], camera->Sky[Z]);
+    Make_Vector(Camera->Look_At, camera->Look_At[X], camera->Look_At[Y], camera->Look_At[Z]);
+
+    if (! Point_Camera(Camera))
+        return 0;
+
+    Camera->Near_Distance = max(0.0, camera->Near_Distance);
+    Camera->Far_Distance = max(0.0, camera->Far_Distance);
+
+    if ((camera->Aperture != 0.0) && (camera->Blur_Samples > 0))
+    {
+        Make_Vector(Camera->Focal_Point, camera->Focal_Point[X], camera->Focal_Point[Y], camera->Focal_Point[Z]);
+        VDist(Camera->Focal_Distance, Camera->Focal_Point, Camera->Location);
+        Camera->Aperture = camera->Aperture;
+        Camera->Blur_Samples = camera->Blur_Samples;
+    }
+    else
+    {
+        VLength(Camera->Focal_Distance, Camera->Direction);
+        Camera->Aperture = 0.0;
+        Camera->Blur_Samples = 0;
+    }
+
+    if (Camera->Focal_Distance == 0.0)
+        Camera->Focal_Distance = 1.0;
+
+    // Render the whole image, or the regions of it given
+    opts.First_Column = opts.First_Line = 0;
+    opts.Last_Column = opts.Last_Line = -1;
+    fix_up_rendering_window();
+
+    Trace_Frame();
+
+    Number_Of_Render_Regions = 0;
+    Render_Regions = NULL;
+    Render_Progress_Callback = NULL;
+
+    return 1;
+}
+
+// Free the scene kept by povray_render_scene, if any
+void povray_release_scene ()
+{
+    if (! Scene_Retained)
+        return;
+
+    Destroy_Frame_Data();
+    povray_terminate();
+
+    Scene_Retained = false;
+}
+
+// Ray counts of the last scene rendered
+void povray_render_statistics (RENDER_STATISTICS* statistics)
+{
+    *statistics = Render_Statistics;
+}
+
 
 /*****************************************************************************
 *
@@ -328,12 +511,19 @@ void povray_terminate()
 *
 * CHANGES
 *
-*   -
+*   @CoppeliaSim@ : Forked worker processes leave with _exit.
 *
 ******************************************************************************/
 
 void povray_exit(int i)
 {
+    /* @CoppeliaSim@ */
+    // A worker process leaves at once; the calling process traces its tiles again
+#if defined(__linux)
+    if (Render_Worker_Process)
+        _exit(1);
+#endif
+
     if(Stage == STAGE_PARSING) 
     {
         Terminate_Tokenizer();
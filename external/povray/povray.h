@@ -100,6 +100,7 @@ USING_POV_BASE_NAMESPACE
 #define GAMMA_CORRECT     0x040000L
 #define FROM_STDIN        0x080000L
 #define TO_STDOUT         0x100000L
+#define USE_RASTER_BUFFER 0x200000L /* @CoppeliaSim@ */
 
 #define Q_FULL_AMBIENT 0x000001L
 #define Q_QUICKC       0x000002L
@@ -424,6 +425,14 @@ typedef struct OPTIONS_STRUCT
   int Noise_Generator;
 
   POVMSAttributeList Declared_Variables;
+
+  /* @CoppeliaSim@ */
+  int Render_Backend;
+  int Render_Workers;
+  DBL Roulette_Weight;
+  DBL Ray_Budget;
+  int Retain_Scene;
+  int Region_Fill;
 } Opts;
 
 
@@ -482,7 +491,105 @@ extern POVMSContext POVMS_Output_Context;
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-int povray_render_scene (const char* file_name, unsigned char* target_buffer, int nx, int ny, int flg);
+/* Render backends */
+
+enum
+{
+  RENDER_BACKEND_SERIAL = 0, /* trace the image in the calling thread */
+  RENDER_BACKEND_FORK   = 1  /* fork worker processes after parsing (Linux only) */
+};
+
+/* What the pixels outside the regions traced get */
+
+enum
+{
+  RENDER_FILL_KEEP       = 0, /* leave the target buffer as it is */
+  RENDER_FILL_BACKGROUND = 1  /* the background colour of the scene */
+};
+
+/* Part of the image to trace, in pixels from the top left corner; the last column and line are excluded */
+
+typedef struct Render_Region_Struct RENDER_REGION;
+
+struct Render_Region_Struct
+{
+  int First_Column;
+  int First_Line;
+  int Last_Column;
+  int Last_Line;
+};
+
+/* Called by the calling process as a part of the image is finished in the target buffer */
+
+typedef void (*RENDER_PROGRESS_CALLBACK) (void* data, const RENDER_REGION* finished);
+
+typedef struct Render_Settings_Struct RENDER_SETTINGS;
+
+struct Render_Settings_Struct
+{
+  int Backend;                /* RENDER_BACKEND_xxx */
+  int Workers;                /* worker processes, 0 for one per processor */
+  int Quality;                /* render quality 0..9 (+Q) */
+  int Antialias;              /* true to antialias (+A) */
+  double Antialias_Threshold; /* antialiasing threshold */
+  int Antialias_Depth;        /* antialiasing depth 1..9 (+R) */
+  int Rasterize;              /* true to rasterize the first hit of meshes for primary rays */
+  double Roulette_Weight;     /* weight below which reflected and transmitted rays play Russian roulette, 0 for never */
+  double Ray_Budget;          /* average rays per pixel the trace depth limit adapts to, 0 for no budget */
+  int Retain_Scene;           /* true to keep the parsed scene for povray_render_view until povray_release_scene */
+  int Number_Of_Regions;      /* regions to trace, 0 for the whole image */
+  const RENDER_REGION* Regions;
+  int Region_Fill;            /* RENDER_FILL_xxx, used with regions */
+  RENDER_PROGRESS_CALLBACK Progress_Callback; /* called with lines or tiles as they are finished, or NULL */
+  void* Progress_Data;        /* passed to the progress callback */
+};
+
+/* Camera to render a retained scene from, given as in the camera statement of a scene file */
+
+typedef struct Render_Camera_Struct RENDER_CAMERA;
+
+struct Render_Camera_Struct
+{
+  int Orthographic;           /* true for an orthographic camera, else perspective */
+  double Location[3];
+  double Direction[3];        /* lengths of direction, right and up are kept when aiming at look_at */
+  double Right[3];
+  double Up[3];
+  double Sky[3];
+  double Look_At[3];
+  double Near_Distance;       /* near clipping distance, 0 for none */
+  double Far_Distance;        /* far clipping distance, 0 for none */
+  double Focal_Point[3];      /* focal blur, used if the aperture and number of samples are not 0 */
+  double Aperture;
+  int Blur_Samples;
+};
+
+#define RENDER_DEPTH_BINS 16
+
+typedef struct Render_Statistics_Struct RENDER_STATISTICS;
+
+struct Render_Statistics_Struct
+{
+  long Pixels;                            /* pixels traced */
+  long Rays;                              /* rays traced, primary and secondary */
+  long Rays_At_Depth[RENDER_DEPTH_BINS];  /* rays by trace level from 1, deeper ones in the last */
+  long Roulette_Survived;                 /* rays continued by Russian roulette */
+  long Roulette_Terminated;               /* rays ended by Russian roulette */
+  int Lowest_Depth_Limit;                 /* lowest trace level the ray budget came down to */
+};
+
+extern RENDER_STATISTICS Render_Statistics; /* counts of the current render */
+extern int Render_Worker_Process;           /* true in forked worker processes */
+extern int Number_Of_Render_Regions;        /* regions of the current render, 0 for the whole image */
+extern const RENDER_REGION* Render_Regions;
+extern RENDER_PROGRESS_CALLBACK Render_Progress_Callback; /* progress callback of the current render, or NULL */
+extern void* Render_Progress_Data;
+
+void povray_init_settings (RENDER_SETTINGS* settings);
+int povray_render_scene (const char* file_name, unsigned char* target_buffer, int nx, int ny, const RENDER_SETTINGS* settings);
+void povray_render_statistics (RENDER_STATISTICS* statistics);
+int povray_render_view (const RENDER_CAMERA* camera, unsigned char* target_buffer, int nx, int ny, const RENDER_SETTINGS* settings);
+void povray_release_scene ();
 
 void povray_init();
 void povray_terminate();
@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 #include <ctype.h>
 #include <time.h>
 #include <algorithm>
@@ -37,6 +43,7 @@
 #include "bezier.h"
 #include "blob.h"
 #include "bbox.h"
+#include "colutils.h" /* @CoppeliaSim@ */
 #include "cones.h"
 #include "csg.h"
 #include "discs.h"
@@ -88,6 +95,16 @@
 #include "povms.h"
 #include "rendctrl.h"
 
+/* @CoppeliaSim@ */
+#if defined(__linux)
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#define POV_FORK_RENDERING 1
+#endif
+
 BEGIN_POV_NAMESPACE
 
 USING_POV_BASE_NAMESPACE
@@ -101,6 +118,19 @@ USING_POV_BASE_NAMESPACE
 const int STORE   = 1;
 const int RESTORE = 2;
 
+/* @CoppeliaSim@ */
+/* Number of lines in a tile handed out to a worker process. */
+
+const int WORKER_TILE_LINES = 16;
+
+/* Interval the calling process checks for tiles finished by the workers at. */
+
+const int WORKER_POLL_MICROSECONDS = 1000;
+
+/* Time a worker process may take over a tile before it is taken to hang and killed. */
+
+const int WORKER_TIMEOUT_SECONDS = 10;
+
 /*****************************************************************************
 * Local typedefs
 ******************************************************************************/
@@ -172,6 +202,23 @@ int closed_flag; // GLOBAL VARIABLE
 int STORE_First_Line; // GLOBAL VARIABLE
 
 
+/*****************************************************************************
+* Static functions
+******************************************************************************/
+
+/* @CoppeliaSim@ */
+static int Build_Trace_Regions(RENDER_REGION **Regions);
+static void Fill_Background(void);
+static void Start_Window_Tracing(void);
+static void Start_Region_Tracing(const RENDER_REGION *Regions, int Number_Of_Regions);
+static void Start_Forked_Tracing(const RENDER_REGION *Regions, int Number_Of_Regions);
+static int Build_Worker_Tiles(const RENDER_REGION *Regions, int Number_Of_Regions, RENDER_REGION **Tiles);
+static void Trace_Worker_Tiles(int worker, int workers, const RENDER_REGION *Tiles, int Number_Of_Tiles, volatile int *Tiles_Done);
+static int Deliver_Worker_Tiles(const RENDER_REGION *Tiles, int Number_Of_Tiles, volatile int *Tiles_Done, char *Delivered, unsigned char *target, const unsigned char *shared, RENDER_PROGRESS_CALLBACK callback);
+static void Add_Render_Statistics(const RENDER_STATISTICS *Statistics);
+static void Build_Frame(void);
+
+
 /*****************************************************************************
 * functions
 ******************************************************************************/
@@ -318,6 +365,46 @@ void FrameLoop()
 ******************************************************************************/
 
 void FrameRender()
+{
+   Build_Frame();
+
+   Trace_Frame();
+
+   /* @CoppeliaSim@ */
+   // A retained scene is left for Trace_Frame to render from other cameras
+   // until Destroy_Frame_Data frees it.
+   if(opts.Retain_Scene)
+      return;
+
+   Destroy_Frame_Data();
+}
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Build_Frame
+*
+* INPUT
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Parse the scene and build everything the camera does not matter to:
+*   bounding slabs, light buffers, the light culling grid and photon maps.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void Build_Frame()
 {
    // Store start time for parse.
    START_TIME
@@ -369,15 +456,6 @@ void FrameRender()
 
    Experimental_Flag = 0;
 
-   // Switch off standard anti-aliasing.
-
-   if((Frame.Camera->Aperture != 0.0) && (Frame.Camera->Blur_Samples > 0))
-   {
-      opts.Options &= ~ANTIALIAS;
-
-      Warning(0, "Focal blur is used. Standard antialiasing is switched off.");
-   }
-
    // Create the bounding box hierarchy.
 
    Stage = STAGE_SLAB_BUILDING;
@@ -395,12 +473,13 @@ void FrameRender()
    // Always call this to print number of objects.
    Build_Bounding_Slabs(&Root_Object);
 
-   // Create the vista buffer.
-   Build_Vista_Buffer();
-
    // Create the light buffers.
    Build_Light_Buffers();
 
+   /* @CoppeliaSim@ */
+   // Create the light culling grid.
+   Build_Light_Culling_Grid();
+
    // Save variable values.
    variable_store(STORE);
 
@@ -430,11 +509,64 @@ void FrameRender()
      tphoton_frame = tphoton;
      tphoton = 0;
    }
+}
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Trace_Frame
+*
+* INPUT
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Trace the parsed scene from the current camera into the target image,
+*   building and destroying the buffers that depend on the camera and the
+*   image size on the way.
+*
+* CHANGES
+*
+******************************************************************************/
+
+void Trace_Frame()
+{
+   RENDER_REGION *Regions; /* @CoppeliaSim@ */
+   int Number_Of_Regions;
 
    /* Store start time for the rest of parsing. */
    START_TIME
    Stage = STAGE_INIT;
 
+   /* @CoppeliaSim@ */
+   // Focal blur samples the blurred pixels over their circle of confusion
+   // and leaves those in focus to standard anti-aliasing, pixel by pixel.
+
+   if((Frame.Camera->Aperture != 0.0) && (Frame.Camera->Blur_Samples > 0))
+   {
+      opts.Options |= ANTIALIAS;
+      opts.Tracing_Method = 1;
+   }
+
+   /* @CoppeliaSim@ */
+   // Narrow the rendering window down to the regions to trace.
+   Number_Of_Regions = Build_Trace_Regions(&Regions);
+
+   // Create the vista buffer.
+   Build_Vista_Buffer();
+
+   /* @CoppeliaSim@ */
+   // Create the raster buffer.
+   Build_Raster_Buffer();
+
    // Open output file and if we are continuing an interrupted trace,
    // read in the previous file settings and any data there.  This has to
    // be done before any image-size related allocations, since the settings
@@ -459,6 +591,10 @@ void FrameRender()
    // Get things ready for ray tracing (misc init, mem alloc)
    Initialize_Renderer();
 
+   /* @CoppeliaSim@ */
+   if((Number_Of_Render_Regions > 0) && (opts.Region_Fill == RENDER_FILL_BACKGROUND) && Display_Started)
+      Fill_Background();
+
    // This had to be taken out of open_output_file() because we don't have
    // the final image size until the output file has been opened, so we can't
    // initialize the display until we know this, which in turn means we can't
@@ -510,15 +646,21 @@ void FrameRender()
    else if((opts.Options & PREVIEW) && (opts.Options & DISPLAY))
       Start_Tracing_Mosaic_Preview(opts.PreviewGridSize_Start, opts.PreviewGridSize_End);
 
-   switch(opts.Tracing_Method)
-   {
-      case 2:
-         Start_Adaptive_Tracing();
-         break;
-      case 1:
-      default:
-         Start_Non_Adaptive_Tracing();
-   }
+   ///////////////////////////////////////////////////////////////////////////////
+   //                                                                           //
+   // @CoppeliaSim@                                                                   //
+   //                                                                           //
+   // The scene is fully parsed and bounded at this point, so worker processes  //
+   // forked now share it copy-on-write                                         //
+   //                                                                           //
+   ///////////////////////////////////////////////////////////////////////////////
+
+   if(opts.Render_Backend == RENDER_BACKEND_FORK)
+      Start_Forked_Tracing(Regions, Number_Of_Regions);
+   else
+      Start_Region_Tracing(Regions, Number_Of_Regions);
+
+   POV_FREE(Regions); /* @CoppeliaSim@ */
 
    // Record time so well spent before file close so it can be in comments
    STOP_TIME
@@ -542,31 +684,10 @@ void FrameRender()
    if((Highest_Trace_Level >= Max_Trace_Level) && (Had_Max_Trace_Level == false))
       PossibleError("Maximum trace level reached! If your scene contains black spots\nread more about the max_trace_level setting in the documentation!");
 
-   Stage = STAGE_SHUTDOWN;
-
-   POV_PRE_SHUTDOWN
-
-   // DESTROY lots of stuff
-   /* NK phmap */
-   FreeBacktraceEverything();
-   Deinitialize_Atmosphere_Code();
-   Deinitialize_BBox_Code();
-   Deinitialize_Lighting_Code();
-   Deinitialize_Mesh_Code();
-   Deinitialize_VLBuffer_Code();
-   Deinitialize_Radiosity_Code();
-   Destroy_Light_Buffers();
-   Destroy_Vista_Buffer();
-   Destroy_Bounding_Slabs();
-   Destroy_Frame();
+   // Destroy what depends on the camera and the image size.
    Terminate_Renderer();
-   FreeFontInfo();
-   Free_Iteration_Stack();
-   Free_Noise_Tables();
-
-   POVFPU_Terminate();
-
-   POV_POST_SHUTDOWN
+   Destroy_Raster_Buffer(); /* @CoppeliaSim@ */
+   Destroy_Vista_Buffer();
 
    if((opts.Options & DISPLAY) && Display_Started)
    {
@@ -593,6 +714,58 @@ void FrameRender()
       // ... and then clear them for the next frame
       init_statistics(stats);
    }
+}
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Destroy_Frame_Data
+*
+* INPUT
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Free the parsed scene and everything built from it.
+*
+* CHANGES
+*
+******************************************************************************/
+
+void Destroy_Frame_Data()
+{
+   Stage = STAGE_SHUTDOWN;
+
+   POV_PRE_SHUTDOWN
+
+   // DESTROY lots of stuff
+   /* NK phmap */
+   FreeBacktraceEverything();
+   Deinitialize_Atmosphere_Code();
+   Deinitialize_BBox_Code();
+   Deinitialize_Lighting_Code();
+   Deinitialize_Mesh_Code();
+   Deinitialize_VLBuffer_Code();
+   Deinitialize_Radiosity_Code();
+   Destroy_Light_Buffers();
+   Destroy_Light_Culling_Grid(); /* @CoppeliaSim@ */
+   Destroy_Bounding_Slabs();
+   Destroy_Frame();
+   FreeFontInfo();
+   Free_Iteration_Stack();
+   Free_Noise_Tables();
+
+   POVFPU_Terminate();
+
+   POV_POST_SHUTDOWN
 
    // Restore variable values.
    variable_store(RESTORE);
@@ -1125,6 +1298,14 @@ void init_vars()
 
   opts.Preview_RefCon = 0;
 
+  /* @CoppeliaSim@ */
+  opts.Render_Backend = RENDER_BACKEND_SERIAL;
+  opts.Render_Workers = 0;
+  opts.Roulette_Weight = 0.0;
+  opts.Ray_Budget = 0.0;
+  opts.Retain_Scene = false;
+  opts.Region_Fill = RENDER_FILL_BACKGROUND;
+
   opts.Warning_Level = 10; // all warnings
 
   opts.String_Encoding = 0; // ASCII
@@ -1364,7 +1545,9 @@ void close_all()
   Terminate_Renderer();
   Destroy_Bounding_Slabs();
   Destroy_Vista_Buffer();
+  Destroy_Raster_Buffer(); /* @CoppeliaSim@ */
   Destroy_Light_Buffers();
+  Destroy_Light_Culling_Grid(); /* @CoppeliaSim@ */
   Destroy_Random_Generators();
   Deinitialize_Radiosity_Code();
   Free_Iteration_Stack();
@@ -1394,4 +1577,645 @@ void close_all()
   closed_flag = true;
 }
 
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Start_Window_Tracing
+*
+* INPUT
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Trace the current rendering window with the selected tracing method.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void Start_Window_Tracing()
+{
+   switch(opts.Tracing_Method)
+   {
+      case 2:
+         Start_Adaptive_Tracing();
+         break;
+      case 1:
+      default:
+         Start_Non_Adaptive_Tracing();
+   }
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Build_Trace_Regions
+*
+* INPUT
+*
+* OUTPUT
+*
+*   Regions - regions to trace, to be freed with POV_FREE
+*
+* RETURNS
+*
+*   int - number of regions
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Clip the regions asked for by the caller to the rendering window, drop
+*   the empty ones and narrow the window down to the bounds of the rest, so
+*   that the vista and raster buffers cover no more than is traced. Without
+*   regions the whole window is the one region.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static int Build_Trace_Regions(RENDER_REGION **Regions)
+{
+   int i, n;
+   RENDER_REGION Region, Bounds;
+
+   *Regions = (RENDER_REGION *)POV_MALLOC(max(1, Number_Of_Render_Regions) * sizeof(RENDER_REGION), "render regions");
+
+   if(Number_Of_Render_Regions <= 0)
+   {
+      (*Regions)[0].First_Column = opts.First_Column;
+      (*Regions)[0].First_Line = opts.First_Line;
+      (*Regions)[0].Last_Column = opts.Last_Column;
+      (*Regions)[0].Last_Line = opts.Last_Line;
+
+      return 1;
+   }
+
+   Bounds.First_Column = opts.Last_Column;
+   Bounds.First_Line = opts.Last_Line;
+   Bounds.Last_Column = opts.First_Column;
+   Bounds.Last_Line = opts.First_Line;
+
+   for(i = n = 0; i < Number_Of_Render_Regions; i++)
+   {
+      Region.First_Column = max(Render_Regions[i].First_Column, opts.First_Column);
+      Region.First_Line = max(Render_Regions[i].First_Line, opts.First_Line);
+      Region.Last_Column = min(Render_Regions[i].Last_Column, opts.Last_Column);
+      Region.Last_Line = min(Render_Regions[i].Last_Line, opts.Last_Line);
+
+      if((Region.First_Column >= Region.Last_Column) || (Region.First_Line >= Region.Last_Line))
+         continue;
+
+      Bounds.First_Column = min(Bounds.First_Column, Region.First_Column);
+      Bounds.First_Line = min(Bounds.First_Line, Region.First_Line);
+      Bounds.Last_Column = max(Bounds.Last_Column, Region.Last_Column);
+      Bounds.Last_Line = max(Bounds.Last_Line, Region.Last_Line);
+
+      (*Regions)[n++] = Region;
+   }
+
+   if(n > 0)
+   {
+      opts.First_Column = Bounds.First_Column;
+      opts.First_Line = Bounds.First_Line;
+      opts.Last_Column = Bounds.Last_Column;
+      opts.Last_Line = Bounds.Last_Line;
+   }
+
+   return n;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Fill_Background
+*
+* INPUT
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Plot the background colour of the scene to the whole image before the
+*   regions are traced over it, as it would come out for a ray missing all
+*   objects outside of any atmosphere.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void Fill_Background()
+{
+   int x, y;
+   DBL grey = 0.0;
+   unsigned char Red, Green, Blue, Alpha = 0;
+
+   extract_colors(Frame.Background_Colour, &Red, &Green, &Blue, &Alpha, &grey);
+
+   for(y = 0; y < Frame.Screen_Height; y++)
+   {
+      for(x = 0; x < Frame.Screen_Width; x++)
+         POV_DISPLAY_PLOT(opts.Preview_RefCon, x, y, Red, Green, Blue, Alpha);
+   }
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Start_Region_Tracing
+*
+* INPUT
+*
+*   Regions, Number_Of_Regions - regions to trace
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Trace the regions one after the other as rendering windows of their own.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void Start_Region_Tracing(const RENDER_REGION *Regions, int Number_Of_Regions)
+{
+   int i;
+   RENDER_REGION Window;
+
+   Window.First_Column = opts.First_Column;
+   Window.First_Line = opts.First_Line;
+   Window.Last_Column = opts.Last_Column;
+   Window.Last_Line = opts.Last_Line;
+
+   for(i = 0; i < Number_Of_Regions; i++)
+   {
+      opts.First_Column = Regions[i].First_Column;
+      opts.First_Line = Regions[i].First_Line;
+      opts.Last_Column = Regions[i].Last_Column;
+      opts.Last_Line = Regions[i].Last_Line;
+
+      Start_Window_Tracing();
+   }
+
+   opts.First_Column = Window.First_Column;
+   opts.First_Line = Window.First_Line;
+   opts.Last_Column = Window.Last_Column;
+   opts.Last_Line = Window.Last_Line;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Build_Worker_Tiles
+*
+* INPUT
+*
+*   Regions, Number_Of_Regions - regions to trace
+*
+* OUTPUT
+*
+*   Tiles - tiles of the regions, to be freed with POV_FREE
+*
+* RETURNS
+*
+*   int - number of tiles
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Cut the regions into tiles of WORKER_TILE_LINES lines. Tiles span the
+*   full width of their region, so anti-aliasing compares pixels with the
+*   same neighbours as in a serial render except across the lines between
+*   tiles: the last line of a tile is not supersampled for differing from
+*   the first line of the next one.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static int Build_Worker_Tiles(const RENDER_REGION *Regions, int Number_Of_Regions, RENDER_REGION **Tiles)
+{
+   int i, line, n = 0;
+
+   for(i = 0; i < Number_Of_Regions; i++)
+      n += (Regions[i].Last_Line - Regions[i].First_Line + WORKER_TILE_LINES - 1) / WORKER_TILE_LINES;
+
+   *Tiles = (RENDER_REGION *)POV_MALLOC(max(1, n) * sizeof(RENDER_REGION), "worker tiles");
+
+   for(i = n = 0; i < Number_Of_Regions; i++)
+   {
+      for(line = Regions[i].First_Line; line < Regions[i].Last_Line; line += WORKER_TILE_LINES, n++)
+      {
+         (*Tiles)[n].First_Column = Regions[i].First_Column;
+         (*Tiles)[n].First_Line = line;
+         (*Tiles)[n].Last_Column = Regions[i].Last_Column;
+         (*Tiles)[n].Last_Line = min(line + WORKER_TILE_LINES, Regions[i].Last_Line);
+      }
+   }
+
+   return n;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Trace_Worker_Tiles
+*
+* INPUT
+*
+*   worker, workers        - index of this worker and number of workers
+*   Tiles, Number_Of_Tiles - tiles of the regions to trace
+*
+* OUTPUT
+*
+*   Tiles_Done - set for each tile traced
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Trace every workers-th tile starting with tile number worker, flagging
+*   each once its pixels are written. Tiles already flagged are skipped.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void Trace_Worker_Tiles(int worker, int workers, const RENDER_REGION *Tiles, int Number_Of_Tiles, volatile int *Tiles_Done)
+{
+   int i;
+   RENDER_REGION Window;
+
+   Window.First_Column = opts.First_Column;
+   Window.First_Line = opts.First_Line;
+   Window.Last_Column = opts.Last_Column;
+   Window.Last_Line = opts.Last_Line;
+
+   for(i = worker; i < Number_Of_Tiles; i += workers)
+   {
+      if(Tiles_Done[i])
+         continue;
+
+      opts.First_Column = Tiles[i].First_Column;
+      opts.First_Line = Tiles[i].First_Line;
+      opts.Last_Column = Tiles[i].Last_Column;
+      opts.Last_Line = Tiles[i].Last_Line;
+
+      Start_Window_Tracing();
+
+      __sync_synchronize();
+      Tiles_Done[i] = true;
+   }
+
+   opts.First_Column = Window.First_Column;
+   opts.First_Line = Window.First_Line;
+   opts.Last_Column = Window.Last_Column;
+   opts.Last_Line = Window.Last_Line;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Deliver_Worker_Tiles
+*
+* INPUT
+*
+*   Tiles, Number_Of_Tiles - tiles of the regions traced
+*   Tiles_Done             - flags of the tiles traced
+*   target, shared         - image to copy the tiles to and from
+*   callback               - progress callback, or NULL
+*
+* OUTPUT
+*
+*   Delivered - set for each tile copied
+*
+* RETURNS
+*
+*   int - number of tiles copied
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Copy the tiles traced since the last call from the shared mapping to
+*   the target buffer and tell the caller about them.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static int Deliver_Worker_Tiles(const RENDER_REGION *Tiles, int Number_Of_Tiles, volatile int *Tiles_Done, char *Delivered, unsigned char *target, const unsigned char *shared, RENDER_PROGRESS_CALLBACK callback)
+{
+   int i, y, n = 0;
+   size_t width, offset;
+
+   for(i = 0; i < Number_Of_Tiles; i++)
+   {
+      if(Delivered[i] || !Tiles_Done[i])
+         continue;
+
+      __sync_synchronize();
+
+      width = (size_t)(Tiles[i].Last_Column - Tiles[i].First_Column) * 3;
+
+      for(y = Tiles[i].First_Line; y < Tiles[i].Last_Line; y++)
+      {
+         offset = ((size_t)y * Frame.Screen_Width + Tiles[i].First_Column) * 3;
+
+         memcpy(target + offset, shared + offset, width);
+      }
+
+      Delivered[i] = true;
+      n++;
+
+      if(callback != NULL)
+         (*callback)(Render_Progress_Data, &Tiles[i]);
+   }
+
+   return n;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Add_Render_Statistics
+*
+* INPUT
+*
+*   Statistics - ray counts of a worker process
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Add the ray counts of a worker to those of the render.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void Add_Render_Statistics(const RENDER_STATISTICS *Statistics)
+{
+   int i;
+
+   Render_Statistics.Pixels += Statistics->Pixels;
+   Render_Statistics.Rays += Statistics->Rays;
+
+   for(i = 0; i < RENDER_DEPTH_BINS; i++)
+      Render_Statistics.Rays_At_Depth[i] += Statistics->Rays_At_Depth[i];
+
+   Render_Statistics.Roulette_Survived += Statistics->Roulette_Survived;
+   Render_Statistics.Roulette_Terminated += Statistics->Roulette_Terminated;
+   Render_Statistics.Lowest_Depth_Limit = min(Render_Statistics.Lowest_Depth_Limit, Statistics->Lowest_Depth_Limit);
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Start_Forked_Tracing
+*
+* INPUT
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Fork worker processes which share the parsed scene copy-on-write and
+*   trace interleaved tiles of the regions into an anonymous shared mapping.
+*   Workers never call back into the host application: messages are dropped
+*   and errors end the worker. A worker which finishes no tile for
+*   WORKER_TIMEOUT_SECONDS is killed. The tiles of a worker which could not
+*   be started or did not finish are traced by the calling process. Falls
+*   back to serial tracing where fork is not available.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void Start_Forked_Tracing(const RENDER_REGION *Regions, int Number_Of_Regions)
+{
+#ifdef POV_FORK_RENDERING
+   int workers = opts.Render_Workers;
+   int i, j, n, tiles, running;
+   int *status, *progress;
+   time_t now, *progress_time;
+   size_t size, image_size;
+   unsigned char *target, *shared;
+   char *delivered;
+   volatile int *tiles_done;
+   RENDER_STATISTICS *worker_statistics;
+   RENDER_REGION *Tiles;
+   RENDER_PROGRESS_CALLBACK callback;
+   pid_t *pids, *done;
+
+   if(workers <= 0)
+      workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+   tiles = Build_Worker_Tiles(Regions, Number_Of_Regions, &Tiles);
+   workers = min(workers, tiles);
+
+   if(workers < 2)
+   {
+      POV_FREE(Tiles);
+      Start_Region_Tracing(Regions, Number_Of_Regions);
+      return;
+   }
+
+   // The image, then the ray counts of each worker, then the flags of the tiles traced.
+   image_size = ((size_t)Frame.Screen_Width * (size_t)Frame.Screen_Height * 3 + 15) & ~(size_t)15;
+   size = image_size + workers * sizeof(RENDER_STATISTICS) + tiles * sizeof(int);
+
+   shared = (unsigned char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+   if(shared == MAP_FAILED)
+   {
+      POV_FREE(Tiles);
+      Start_Region_Tracing(Regions, Number_Of_Regions);
+      return;
+   }
+
+   target = opts.Preview_RefCon;
+   opts.Preview_RefCon = shared;
+   worker_statistics = (RENDER_STATISTICS *)(shared + image_size);
+   tiles_done = (volatile int *)(worker_statistics + workers);
+
+   // Lines traced in the shared mapping are passed on once copied to the target.
+   callback = Render_Progress_Callback;
+   Render_Progress_Callback = NULL;
+
+   pids = (pid_t *)POV_MALLOC(2 * workers * sizeof(pid_t), "worker processes");
+   done = pids + workers;
+   status = (int *)POV_MALLOC(2 * workers * sizeof(int), "worker status");
+   progress = status + workers;
+   progress_time = (time_t *)POV_MALLOC(workers * sizeof(time_t), "worker progress");
+   delivered = (char *)POV_CALLOC(tiles, sizeof(char), "delivered tiles");
+
+   for(i = 0; i < workers; i++)
+   {
+      done[i] = 0;
+      progress[i] = 0;
+      progress_time[i] = time(NULL);
+      pids[i] = fork();
+
+      if(pids[i] == 0)
+      {
+         // Count only the worker's own rays; never return into the host application,
+         // not even on errors.
+         Render_Worker_Process = true;
+         memset(Render_Statistics.Rays_At_Depth, 0, sizeof(Render_Statistics.Rays_At_Depth));
+         Render_Statistics.Pixels = Render_Statistics.Rays = 0;
+         Render_Statistics.Roulette_Survived = Render_Statistics.Roulette_Terminated = 0;
+
+         Trace_Worker_Tiles(i, workers, Tiles, tiles, tiles_done);
+
+         worker_statistics[i] = Render_Statistics;
+         _exit(0);
+      }
+   }
+
+   // Pass tiles on as they are finished while the workers run, and kill workers
+   // which stopped finishing tiles. Never block on a worker.
+   do
+   {
+      running = 0;
+      now = time(NULL);
+
+      for(i = 0; i < workers; i++)
+      {
+         if((pids[i] <= 0) || (done[i] != 0))
+            continue;
+
+         done[i] = waitpid(pids[i], &status[i], WNOHANG);
+
+         if((done[i] < 0) && (errno == EINTR))
+            done[i] = 0;
+
+         if(done[i] != 0)
+            continue;
+
+         for(n = 0, j = i; j < tiles; j += workers)
+            n += (tiles_done[j] != 0);
+
+         if(n != progress[i])
+         {
+            progress[i] = n;
+            progress_time[i] = now;
+         }
+         else if(now - progress_time[i] > WORKER_TIMEOUT_SECONDS)
+         {
+            // Hung; killed with SIGKILL the worker is reaped at once
+            kill(pids[i], SIGKILL);
+
+            do
+               done[i] = waitpid(pids[i], &status[i], 0);
+            while((done[i] < 0) && (errno == EINTR));
+
+            continue;
+         }
+
+         running++;
+      }
+
+      if((Deliver_Worker_Tiles(Tiles, tiles, tiles_done, delivered, target, shared, callback) == 0) && (running > 0))
+         usleep(WORKER_POLL_MICROSECONDS);
+   }
+   while(running > 0);
+
+   for(i = 0; i < workers; i++)
+   {
+      if((pids[i] > 0) && (done[i] == pids[i]) && WIFEXITED(status[i]) && (WEXITSTATUS(status[i]) == 0))
+      {
+         Add_Render_Statistics(&worker_statistics[i]);
+         continue;
+      }
+
+      Trace_Worker_Tiles(i, workers, Tiles, tiles, tiles_done);
+   }
+
+   opts.Preview_RefCon = target;
+   Render_Progress_Callback = callback;
+
+   Deliver_Worker_Tiles(Tiles, tiles, tiles_done, delivered, target, shared, callback);
+
+   POV_FREE(delivered);
+   POV_FREE(progress_time);
+   POV_FREE(status);
+   POV_FREE(pids);
+   POV_FREE(Tiles);
+
+   munmap(shared, size);
+#else
+   Start_Region_Tracing(Regions, Number_Of_Regions);
+#endif
+}
+
 END_POV_NAMESPACE
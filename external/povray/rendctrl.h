@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 
 #ifndef RENDCTRL_H
 #define RENDCTRL_H
@@ -42,6 +48,8 @@ void fix_up_rendering_window (void);
 void fix_up_animation_values (void);
 void fix_up_scene_name (void);
 void FrameRender (void);
+void Trace_Frame (void); /* @CoppeliaSim@ */
+void Destroy_Frame_Data (void); /* @CoppeliaSim@ */
 void FrameLoop();
 void variable_store (int Flag);
 
@@ -33,6 +33,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 #include <time.h>
 #include <algorithm>
 
@@ -90,6 +96,15 @@ const int hexgrid4size = 37;
 
 const int SUB_PIXEL_GRID_SIZE = 16;
 
+/* @CoppeliaSim@ */
+/* Blur radius (in pixels) below which a pixel is in focus and antialiased as without focal blur. */
+
+const DBL BLUR_RADIUS_IN_FOCUS = 1.0;
+
+/* Number of focal blur samples taken per pixel of blur radius. */
+
+const DBL BLUR_SAMPLES_PER_PIXEL = 2.0;
+
 #ifndef ALLOW_SMOOT_RAD_PREVIEW
 #define ALLOW_SMOOT_RAD_PREVIEW 1
 #endif
@@ -100,12 +115,22 @@ const int SUB_PIXEL_GRID_SIZE = 16;
 
 typedef struct Pixel_Struct PIXEL;
 typedef struct Vec2_Struct VEC2;
+typedef struct Blur_Sample_Struct BLUR_SAMPLE; /* @CoppeliaSim@ */
 
 struct Vec2_Struct
 {
   DBL x, y;
 };
 
+/* @CoppeliaSim@ */
+/* Focal blur sample: sub-pixel position and aperture jitter in [-0.5, 0.5). */
+
+struct Blur_Sample_Struct
+{
+  VEC2 Pixel;
+  VEC2 Jitter;
+};
+
 struct Pixel_Struct
 {
   int active;
@@ -120,6 +145,10 @@ struct Pixel_Struct
 /* NK depth */
 DBL Total_Depth = 0.0; // GLOBAL VARIABLE
 
+/* @CoppeliaSim@ */
+DBL Pixel_Footprint_Width = 0.0; // GLOBAL VARIABLE
+DBL Pixel_Footprint_Angle = 0.0; // GLOBAL VARIABLE
+
 COLOUR *Previous_Line = NULL, *Current_Line = NULL, *Temp_Line = NULL; // GLOBAL VARIABLE
 char *Previous_Line_Antialiased_Flags = NULL, *Current_Line_Antialiased_Flags = NULL; // GLOBAL VARIABLE
 
@@ -220,6 +249,65 @@ static DBL Max_Jitter; // GLOBAL VARIABLE
 
 static VECTOR XPerp, YPerp; // GLOBAL VARIABLE
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// @CoppeliaSim@                                                                   //
+//                                                                           //
+// View clipping: primary rays start at the near plane and give up beyond    //
+// the far plane, so that objects need not be clipped individually           //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+/* Flag telling if near/far clipping of primary rays is used. */
+
+static int View_Clipping_Is_Used; // GLOBAL VARIABLE
+
+/* Normalized viewing direction of the camera. */
+
+static VECTOR View_Axis; // GLOBAL VARIABLE
+
+/* Maximum depth (measured from the near plane) of the current primary ray. */
+
+static DBL Primary_Ray_Max_Depth = BOUND_HUGE; // GLOBAL VARIABLE
+
+/* Pixel whose centre the current primary ray goes through, if the raster buffer is used. */
+
+static int Raster_Pixel_X = -1, Raster_Pixel_Y = -1; // GLOBAL VARIABLE
+
+/* Trace level the ray budget holds rays to, and the line it was last adapted on. */
+
+static int Trace_Depth_Limit = MAX_TRACE_LEVEL_LIMIT; // GLOBAL VARIABLE
+static int Trace_Budget_Line = -1; // GLOBAL VARIABLE
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// @CoppeliaSim@                                                                   //
+//                                                                           //
+// Adaptive focal blur: the number of rays per pixel follows the circle of   //
+// confusion at the first hit of a pinhole ray, and samples are taken from   //
+// a precomputed low-discrepancy table                                       //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+/* Halton sequence of focal blur samples. */
+
+static BLUR_SAMPLE *Blur_Sample_Table; // GLOBAL VARIABLE
+
+/* Aperture jitter of the current focal blur sample. */
+
+static VEC2 Blur_Jitter; // GLOBAL VARIABLE
+
+/*
+ * Blur radius reaching each pixel of the frame, from the pixel itself or
+ * spread from the pixels around it, or NULL if every pixel is fully blurred.
+ */
+
+static DBL *Blur_Radius_Buffer; // GLOBAL VARIABLE
+
+/* Blur radius in pixels per unit of relative distance to the focal plane. */
+
+static DBL Blur_Radius_Scale; // GLOBAL VARIABLE
+
 /* 2*2 grid */
 
 const VEC2 grid1[grid1size] =
@@ -375,12 +463,18 @@ void trace_pixel (int x, int y, COLOUR ColourClipped, COLOUR ColourUnclipped);
 
 static void focal_blur (RAY *Ray, COLOUR Colour, DBL x, DBL y);
 static void jitter_camera_ray (RAY *ray, int ray_number);
+static DBL focal_blur_radius (DBL z);
+static void build_blur_radius_buffer (void);
+static DBL pixel_blur_radius (int x, int y);
+static DBL first_hit_depth (RAY *Ray);
+static DBL radical_inverse (int i, int base);
 static void do_anti_aliasing (int x, int y, COLOUR Colour);
 static int  create_ray (RAY *ray, DBL x, DBL y, int ray_number);
 static void supersample (COLOUR result, int x, int y);
 static void jitter_pixel_position (int x, int y, DBL *Jitter_X, DBL *Jitter_Y);
 static void trace_sub_pixel (int level, PIXEL **Block, int x, int y, int x1, int y1, int x2, int y2, int size, COLOUR Colour, int antialias);
 static void trace_ray_with_offset (int x, int y, DBL dx, DBL dy, COLOUR Colour);
+static void adapt_trace_depth (void); /* @CoppeliaSim@ */
 static void initialize_ray_container_state_tree (RAY *Ray, BBOX_TREE *Node);
 
 
@@ -419,11 +513,47 @@ void Initialize_Renderer (void)
   long size;
   DBL x, y, len;
   DBL T1;
+  DBL aperture_offset, right_len; /* @CoppeliaSim@ */
   VEC2 const *Standard_Sample_Grid;
 
   maxclr = (DBL)(1 << Color_Bits) - 1.0;
   Radiosity_Trace_Level = 1;
 
+  /* @CoppeliaSim@ */
+  /* Count rays afresh; the ray budget starts from the full trace depth. */
+
+  memset(&Render_Statistics, 0, sizeof(Render_Statistics));
+
+  Trace_Depth_Limit = Max_Trace_Level;
+  Trace_Budget_Line = -1;
+
+  Render_Statistics.Lowest_Depth_Limit = Trace_Depth_Limit;
+
+  /* Width of a pixel where rays hit, for filtering image textures. */
+
+  Pixel_Footprint_Width = 0.0;
+  Pixel_Footprint_Angle = 0.0;
+
+  VLength(right_len, Frame.Camera->Right);
+
+  switch (Frame.Camera->Type)
+  {
+    case PERSPECTIVE_CAMERA:
+
+      VLength(len, Frame.Camera->Direction);
+
+      if (len > 0.0)
+        Pixel_Footprint_Angle = right_len / (len * (DBL)Frame.Screen_Width);
+
+      break;
+
+    case ORTHOGRAPHIC_CAMERA:
+
+      Pixel_Footprint_Width = right_len / (DBL)Frame.Screen_Width;
+
+      break;
+  }
+
   size = (Frame.Screen_Width + 1) * sizeof(COLOUR);
 
   Previous_Line = (COLOUR *)POV_MALLOC(size, "previous line buffer");
@@ -470,6 +600,10 @@ void Initialize_Renderer (void)
 
   Sample_Threshold = NULL;
 
+  Blur_Sample_Table = NULL; /* @CoppeliaSim@ */
+
+  Blur_Radius_Buffer = NULL;
+
   if (Focal_Blur_Is_Used)
   {
     /* Create list of thresholds for confidence test. */
@@ -662,8 +796,64 @@ void Initialize_Renderer (void)
     VLength(len, Frame.Camera->Direction);
 
     Focal_Distance = Frame.Camera->Focal_Distance / len;
+
+    /* Create the low-discrepancy sample table. */
+
+    Blur_Sample_Table = (BLUR_SAMPLE *)POV_MALLOC(Frame.Camera->Blur_Samples*sizeof(BLUR_SAMPLE), "focal blur sample table");
+
+    for (i = 0; i < Frame.Camera->Blur_Samples; i++)
+    {
+      Blur_Sample_Table[i].Pixel.x  = radical_inverse(i, 2);
+      Blur_Sample_Table[i].Pixel.y  = radical_inverse(i, 3);
+      Blur_Sample_Table[i].Jitter.x = radical_inverse(i, 5);
+      Blur_Sample_Table[i].Jitter.y = radical_inverse(i, 7);
+    }
+
+    /*
+     * A ray through the aperture offset by d crosses the plane at depth z
+     * off by d * |1 - z/F|. Get the pixel size of that offset for the
+     * largest aperture offset; only the simple cameras are adaptive.
+     */
+
+    aperture_offset = 0.0;
+
+    for (i = 0; i < Frame.Camera->Blur_Samples; i++)
+    {
+      aperture_offset = max(aperture_offset, sqrt(Sqr(Sample_Grid[i].x) + Sqr(Sample_Grid[i].y)));
+    }
+
+    aperture_offset = Frame.Camera->Aperture * 0.5 * (aperture_offset + sqrt(2.0) * Max_Jitter);
+
+    VLength(right_len, Frame.Camera->Right);
+
+    switch (Frame.Camera->Type)
+    {
+      case PERSPECTIVE_CAMERA:
+
+        Blur_Radius_Scale = aperture_offset * len * (DBL)Frame.Screen_Width / right_len;
+
+        break;
+
+      case ORTHOGRAPHIC_CAMERA:
+
+        Blur_Radius_Scale = aperture_offset * (DBL)Frame.Screen_Width / right_len;
+
+        break;
+
+      default:
+
+        Blur_Radius_Scale = 0.0;
+    }
   }
 
+  /* Init view clipping stuff. */
+
+  View_Clipping_Is_Used = (Frame.Camera->Near_Distance > 0.0) || (Frame.Camera->Far_Distance > 0.0);
+
+  VNormalize(View_Axis, Frame.Camera->Direction);
+
+  Primary_Ray_Max_Depth = BOUND_HUGE;
+
   /* If a single frame is traced disable field rendering. */
 /* Disabled 11/12/95 CEY
   if (opts.FrameSeq.FrameType == FT_SINGLE_FRAME)
@@ -677,6 +867,14 @@ void Initialize_Renderer (void)
   Precompute_Camera_Constants = true;
 
   Primary_Ray_State_Tested = false; 
+
+  /* @CoppeliaSim@ */
+  /* Get the blur radius of every pixel before tracing any of them. */
+
+  if (Focal_Blur_Is_Used && (Blur_Radius_Scale > 0.0))
+  {
+    build_blur_radius_buffer();
+  }
 }
 
 
@@ -754,6 +952,22 @@ void Terminate_Renderer()
 
       Sample_Grid = NULL;
     }
+
+    /* @CoppeliaSim@ */
+
+    if (Blur_Sample_Table != NULL)
+    {
+      POV_FREE(Blur_Sample_Table);
+
+      Blur_Sample_Table = NULL;
+    }
+
+    if (Blur_Radius_Buffer != NULL)
+    {
+      POV_FREE(Blur_Radius_Buffer);
+
+      Blur_Radius_Buffer = NULL;
+    }
   }
 }
 
@@ -781,7 +995,7 @@ void Terminate_Renderer()
 *
 * CHANGES
 *
-*   -
+*   @CoppeliaSim@ : Forked worker processes do not process messages.
 *
 ******************************************************************************/
 
@@ -789,7 +1003,9 @@ void Check_User_Abort(int Forced)
 {
     if(Forced)
         Stop_Flag=true;
-    else
+    /* @CoppeliaSim@ */
+    // Forked worker processes never call into the host application
+    else if(!Render_Worker_Process)
     {
         (void)POVMS_ProcessMessages(POVMS_Render_Context, false);
         if(--opts.Abort_Test_Counter <= 0)
@@ -1717,7 +1933,7 @@ static int IsObjectInCSG(OBJECT *Object, OBJECT *parent)
 
 DBL Trace(RAY *Ray, COLOUR Colour, DBL Weight)
 {
-  int i, Intersection_Found, all_hollow;
+  int i, Intersection_Found, Raster_Found, all_hollow;
   OBJECT *Object;
   INTERSECTION Best_Intersection, New_Intersection;
   /* NK phmap */
@@ -1735,7 +1951,7 @@ DBL Trace(RAY *Ray, COLOUR Colour, DBL Weight)
 
   /* Check for max. trace level or ADC bailout. */
 
-  if ((Trace_Level > Max_Trace_Level) || (Weight < ADC_Bailout))
+  if ((Trace_Level > Max_Trace_Level) || (Trace_Level > Trace_Depth_Limit) || (Weight < ADC_Bailout))
   {
     if (Weight < ADC_Bailout)
     {
@@ -1745,6 +1961,13 @@ DBL Trace(RAY *Ray, COLOUR Colour, DBL Weight)
     return (BOUND_HUGE);
   }
 
+  /* @CoppeliaSim@ */
+  if (!backtraceFlag)
+  {
+    Render_Statistics.Rays++;
+    Render_Statistics.Rays_At_Depth[min(Trace_Level, RENDER_DEPTH_BINS) - 1]++;
+  }
+
   /* Set highest level traced. */
 
   if (Trace_Level > Highest_Trace_Level)
@@ -1759,7 +1982,24 @@ DBL Trace(RAY *Ray, COLOUR Colour, DBL Weight)
   Best_Intersection.Depth = BOUND_HUGE;
   Best_Intersection.Object = NULL;
 
-  if (!opts.Use_Slabs)
+  /* @CoppeliaSim@ */
+  /* Take the first hit of a pixel centre ray from the raster buffer if it can tell. */
+
+  Raster_Found = -1;
+
+  if ((Trace_Level == 1) && !backtraceFlag && (Raster_Pixel_Y >= 0))
+  {
+    Raster_Found = Intersect_Raster_Buffer(Ray, Raster_Pixel_X, Raster_Pixel_Y,
+           &Best_Intersection);
+
+    Raster_Pixel_Y = -1;
+  }
+
+  if (Raster_Found >= 0)
+  {
+    Intersection_Found = Raster_Found;
+  }
+  else if (!opts.Use_Slabs)
   {
     for (Object = Frame.Objects; Object != NULL; Object = Object -> Sibling)
     {
@@ -1784,6 +2024,14 @@ DBL Trace(RAY *Ray, COLOUR Colour, DBL Weight)
            &Best_Intersection, &Object, false);
   }
 
+  /* Primary rays see nothing beyond the far clipping plane. */
+
+  if (Intersection_Found && (Trace_Level == 1) && !backtraceFlag &&
+      (Best_Intersection.Depth > Primary_Ray_Max_Depth))
+  {
+    Intersection_Found = false;
+  }
+
   /* Get color for this ray. */
 
   if (Intersection_Found)
@@ -2008,6 +2256,9 @@ static void do_anti_aliasing(register int x, register int y, COLOUR Colour)
 *
 *   Aug 1997 : Set "In_Reflection_Ray" to false [ENB]
 *
+*   @CoppeliaSim@ : Under focal blur only the pixels in focus are
+*              supersampled, with pinhole rays.
+*
 ******************************************************************************/
 
 static void supersample(COLOUR result, int x, int  y)
@@ -2026,6 +2277,14 @@ static void supersample(COLOUR result, int x, int  y)
     return;
   }
 
+  /* @CoppeliaSim@ */
+  /* Focal blur has already sampled a blurred pixel over its circle of confusion. */
+
+  if (Focal_Blur_Is_Used && (pixel_blur_radius(x, y) >= BLUR_RADIUS_IN_FOCUS))
+  {
+    return;
+  }
+
   Increase_Counter(stats[Number_Of_Pixels_Supersampled]);
 
   /* Number of samples in pixel (used to scale resulting color). */
@@ -2080,7 +2339,10 @@ static void supersample(COLOUR result, int x, int  y)
       dx = Jitter_X + i * JScale;
       dy = Jitter_Y + j * JScale;
 
-      if(create_ray(&Camera_Ray, (DBL)x+dx, (DBL)y+dy, 0))
+      /* @CoppeliaSim@ */
+      /* Pixels in focus take pinhole rays under focal blur. */
+
+      if(create_ray(&Camera_Ray, (DBL)x+dx, (DBL)y+dy, -1))
       {
         Trace_Level = 1;
 
@@ -2379,6 +2641,11 @@ static void trace_ray_with_offset(int x, int  y, DBL dx, DBL dy, COLOUR Colour)
 *
 *   Aug 1997 : Set "In_Reflection_Ray" to false [ENB]
 *
+*   @CoppeliaSim@ : The number of samples follows the blur radius
+*              reaching the pixel, pixels in focus take a pinhole ray
+*              and are left to standard antialiasing, and sub-pixel
+*              locations and aperture jitter come from a Halton sequence.
+*
 ******************************************************************************/
 
 static void focal_blur(RAY *Ray, COLOUR Colour, DBL x, DBL  y)
@@ -2386,10 +2653,11 @@ static void focal_blur(RAY *Ray, COLOUR Colour, DBL x, DBL  y)
   int nr;     /* Number of current samples. */
   int level;  /* Index into number of samples list. */
   int max_s;  /* Number of samples to take before next confidence test. */
-  int dxi, dyi;
+  int max_nr; /* Number of samples needed for the blur radius. */
   int i;
-  DBL dx, dy, n;
+  DBL dx, dy, n, radius;
   COLOUR C, V1, S1, S2;
+  BLUR_SAMPLE Offset;
 
   Make_ColourA(Colour, 0.0, 0.0, 0.0, 0.0, 0.0);
 
@@ -2399,11 +2667,65 @@ static void focal_blur(RAY *Ray, COLOUR Colour, DBL x, DBL  y)
 
   Make_ColourA(S2, 0.0, 0.0, 0.0, 0.0, 0.0);
 
-  nr = 0;
+  /*
+   * @CoppeliaSim@
+   *
+   * Trace a pinhole ray through the pixel centre first. It is the only
+   * sample of a pixel in focus, which is antialiased as without blur.
+   */
+
+  if (create_ray(Ray, x, y, -1))
+  {
+    Trace_Level = 1;
+    In_Reflection_Ray = false;
+    In_Shadow_Ray = false;
+
+    Increase_Counter(stats[Number_Of_Samples]);
+
+    Trace(Ray, C, 1.0);
+
+    Add_Colour(Colour, Colour, C);
+  }
+  else
+  {
+    Make_ColourA(C, 0.0, 0.0, 0.0, 0.0, 1.0);
+  }
+
+  Assign_Colour(S1, C);
+
+  S2[pRED]    = Sqr(C[pRED]);
+  S2[pGREEN]  = Sqr(C[pGREEN]);
+  S2[pBLUE]   = Sqr(C[pBLUE]);
+  S2[pTRANSM] = Sqr(C[pTRANSM]);
+
+  nr = 1;
+
+  /*
+   * Blurred neighbours spill over onto sharp pixels as far as their blur
+   * radius reaches, so use the largest radius spread over this pixel.
+   */
+
+  radius = pixel_blur_radius((int)x, (int)y);
+
+  if (radius < BLUR_RADIUS_IN_FOCUS)
+  {
+    max_nr = 1;
+  }
+  else
+  {
+    max_nr = min(Frame.Camera->Blur_Samples, 1 + (int)ceil(BLUR_SAMPLES_PER_PIXEL * radius));
+  }
+
+  /* Rotate the sample table randomly for each pixel. */
+
+  Offset.Pixel.x  = FRAND();
+  Offset.Pixel.y  = FRAND();
+  Offset.Jitter.x = FRAND();
+  Offset.Jitter.y = FRAND();
 
   level = 0;
 
-  do
+  while (nr < max_nr)
   {
     /* Trace number of rays given by the list Current_Number_Of_Samples[]. */
 
@@ -2419,20 +2741,21 @@ static void focal_blur(RAY *Ray, COLOUR Colour, DBL x, DBL  y)
       }
     }
 
-    for (i = 0; (i < max_s) && (nr < Frame.Camera->Blur_Samples); i++)
+    for (i = 0; (i < max_s) && (nr < max_nr); i++)
     {
-      /* Choose sub-pixel location. */
+      /* Choose sub-pixel location and aperture jitter. */
 
-      dxi = POV_RAND() % SUB_PIXEL_GRID_SIZE;
-      dyi = POV_RAND() % SUB_PIXEL_GRID_SIZE;
+      dx = Blur_Sample_Table[nr].Pixel.x + Offset.Pixel.x;
+      dy = Blur_Sample_Table[nr].Pixel.y + Offset.Pixel.y;
 
-      dx = (DBL)(2 * dxi + 1) / (DBL)(2 * SUB_PIXEL_GRID_SIZE) - 0.5;
-      dy = (DBL)(2 * dyi + 1) / (DBL)(2 * SUB_PIXEL_GRID_SIZE) - 0.5;
+      dx -= floor(dx) + 0.5;
+      dy -= floor(dy) + 0.5;
 
-      /* Add jitter to sub-pixel location. */
+      Blur_Jitter.x = Blur_Sample_Table[nr].Jitter.x + Offset.Jitter.x;
+      Blur_Jitter.y = Blur_Sample_Table[nr].Jitter.y + Offset.Jitter.y;
 
-      dx += (FRAND() - 0.5) / (DBL)(SUB_PIXEL_GRID_SIZE);
-      dy += (FRAND() - 0.5) / (DBL)(SUB_PIXEL_GRID_SIZE);
+      Blur_Jitter.x -= floor(Blur_Jitter.x) + 0.5;
+      Blur_Jitter.y -= floor(Blur_Jitter.y) + 0.5;
 
       /* Create and trace ray. */
 
@@ -2490,13 +2813,333 @@ static void focal_blur(RAY *Ray, COLOUR Colour, DBL x, DBL  y)
       break;
     }
   }
-  while (nr < Frame.Camera->Blur_Samples);
 
   Scale_Colour(Colour, Colour, 1.0 / (DBL)nr);
 }
 
 
 
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   focal_blur_radius
+*
+* INPUT
+*
+*   z - depth of a point along the viewing direction
+*
+* OUTPUT
+*
+* RETURNS
+*
+*   DBL - radius of the circle of confusion of the point in pixels
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Cameras other than perspective and orthographic are always treated as
+*   fully blurred.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static DBL focal_blur_radius(DBL z)
+{
+  DBL F = Frame.Camera->Focal_Distance;
+
+  switch (Frame.Camera->Type)
+  {
+    case PERSPECTIVE_CAMERA:
+
+      if (z < EPSILON)
+      {
+        return(BOUND_HUGE);
+      }
+
+      return(Blur_Radius_Scale * fabs(F - z) / (F * z));
+
+    case ORTHOGRAPHIC_CAMERA:
+
+      return(Blur_Radius_Scale * fabs(F - z) / F);
+  }
+
+  return(BOUND_HUGE);
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   build_blur_radius_buffer
+*
+* INPUT
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   A blurred pixel smears over the pixels within its blur radius, so a
+*   sharp pixel near it needs as many samples as if it were blurred by
+*   what is left of that radius. Get the radius at the first hit of a
+*   pinhole ray through each pixel, then spread it over the whole frame,
+*   less one per pixel of distance along each axis, with a max filter
+*   run both ways along the lines and then along the columns.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void build_blur_radius_buffer()
+{
+  int x, y, i, Width, Height;
+  DBL z, depth, limit;
+  DBL *Radius;
+  VECTOR P;
+  RAY Ray;
+
+  Width = Frame.Screen_Width;
+  Height = Frame.Screen_Height;
+
+  Blur_Radius_Buffer = (DBL *)POV_MALLOC(Width * Height * sizeof(DBL), "focal blur radius buffer");
+
+  /* No radius needs to reach further than across the frame. */
+
+  limit = (DBL)(Width + Height);
+
+  for (y = 0; y < Height; y++)
+  {
+    Radius = &Blur_Radius_Buffer[y * Width];
+
+    for (x = 0; x < Width; x++)
+    {
+      z = BOUND_HUGE;
+
+      if (create_ray(&Ray, (DBL)x, (DBL)y, -1))
+      {
+        depth = first_hit_depth(&Ray);
+
+        if (depth < BOUND_HUGE)
+        {
+          VEvaluateRay(P, Ray.Initial, depth, Ray.Direction);
+          VSubEq(P, Frame.Camera->Location);
+          VDot(z, P, View_Axis);
+        }
+      }
+
+      Radius[x] = min(focal_blur_radius(z), limit);
+    }
+
+    for (x = 1; x < Width; x++)
+    {
+      Radius[x] = max(Radius[x], Radius[x - 1] - 1.0);
+    }
+
+    for (x = Width - 2; x >= 0; x--)
+    {
+      Radius[x] = max(Radius[x], Radius[x + 1] - 1.0);
+    }
+  }
+
+  for (y = 1; y < Height; y++)
+  {
+    Radius = &Blur_Radius_Buffer[y * Width];
+
+    for (x = 0; x < Width; x++)
+    {
+      Radius[x] = max(Radius[x], Radius[x - Width] - 1.0);
+    }
+  }
+
+  for (y = Height - 2; y >= 0; y--)
+  {
+    Radius = &Blur_Radius_Buffer[y * Width];
+
+    for (x = 0; x < Width; x++)
+    {
+      Radius[x] = max(Radius[x], Radius[x + Width] - 1.0);
+    }
+  }
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   pixel_blur_radius
+*
+* INPUT
+*
+*   x, y - pixel traced
+*
+* OUTPUT
+*
+* RETURNS
+*
+*   DBL - largest blur radius reaching the pixel
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Pixels outside the frame, such as the line above it that antialiasing
+*   traces, take the radius of the nearest pixel in the frame.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static DBL pixel_blur_radius(int x, int y)
+{
+  if (Blur_Radius_Buffer == NULL)
+  {
+    return(BOUND_HUGE);
+  }
+
+  x = max(0, min(x, Frame.Screen_Width - 1));
+  y = max(0, min(y, Frame.Screen_Height - 1));
+
+  return(Blur_Radius_Buffer[y * Frame.Screen_Width + x]);
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   first_hit_depth
+*
+* INPUT
+*
+*   Ray - primary ray
+*
+* OUTPUT
+*
+* RETURNS
+*
+*   DBL - depth of the first object the ray hits, BOUND_HUGE if none
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Intersect a primary ray with the scene as Trace() does, without
+*   shading the hit.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static DBL first_hit_depth(RAY *Ray)
+{
+  int Intersection_Found;
+  OBJECT *Object;
+  INTERSECTION Best_Intersection, New_Intersection;
+
+  In_Reflection_Ray = false;
+  In_Shadow_Ray = false;
+
+  Intersection_Found = false;
+
+  Best_Intersection.Depth = BOUND_HUGE;
+  Best_Intersection.Object = NULL;
+
+  if (!opts.Use_Slabs)
+  {
+    for (Object = Frame.Objects; Object != NULL; Object = Object -> Sibling)
+    {
+      if (TEST_RAY_FLAGS(Object) && Intersection(&New_Intersection, Object, Ray))
+      {
+        if (New_Intersection.Depth < Best_Intersection.Depth)
+        {
+          Best_Intersection = New_Intersection;
+
+          Intersection_Found = true;
+        }
+      }
+    }
+  }
+  else
+  {
+    Intersection_Found = Intersect_BBox_Tree(Root_Object, Ray,
+           &Best_Intersection, &Object, false);
+  }
+
+  if (!Intersection_Found || (Best_Intersection.Depth > Primary_Ray_Max_Depth))
+  {
+    return(BOUND_HUGE);
+  }
+
+  return(Best_Intersection.Depth);
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   radical_inverse
+*
+* INPUT
+*
+*   i    - index into the sequence
+*   base - prime base of the sequence
+*
+* OUTPUT
+*
+* RETURNS
+*
+*   DBL - i-th element of the Halton sequence in [0, 1)
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+* CHANGES
+*
+******************************************************************************/
+
+static DBL radical_inverse(int i, int base)
+{
+  DBL result = 0.0;
+  DBL digit = 1.0 / (DBL)base;
+
+  while (i > 0)
+  {
+    result += digit * (DBL)(i % base);
+
+    i /= base;
+
+    digit /= (DBL)base;
+  }
+
+  return(result);
+}
+
+
+
 /*****************************************************************************
 *
 * FUNCTION
@@ -2532,10 +3175,18 @@ static void jitter_camera_ray(RAY *ray, int ray_number)
   DBL xjit, yjit, xlen, ylen, r;
   VECTOR temp_xperp, temp_yperp, deflection;
 
+  /* @CoppeliaSim@ */
+  /* The pinhole ray of adaptive focal blur passes through the aperture centre. */
+
+  if (ray_number < 0)
+  {
+    return;
+  }
+
   r = Frame.Camera->Aperture * 0.5;
 
-  xjit = Max_Jitter * ((FRAND() * 2.0) - 1.0);
-  yjit = Max_Jitter * ((FRAND() * 2.0) - 1.0);
+  xjit = Max_Jitter * 2.0 * Blur_Jitter.x;
+  yjit = Max_Jitter * 2.0 * Blur_Jitter.y;
 
   xlen = r * (Sample_Grid[ray_number].x + xjit);
   ylen = r * (Sample_Grid[ray_number].y + yjit);
@@ -2566,6 +3217,60 @@ static void jitter_camera_ray(RAY *ray, int ray_number)
 
 
 
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   adapt_trace_depth
+*
+* INPUT
+*
+* OUTPUT
+*
+* RETURNS
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Once per line, lower the trace depth limit by one level while the
+*   rays traced so far average more than opts.Ray_Budget per pixel, and
+*   raise it back towards max_trace_level while they average less than
+*   three quarters of it. The gap keeps neighbouring lines from toggling
+*   between two depths. Reflections and refractions keep at least one
+*   level, so the budget only trims what lies behind them.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void adapt_trace_depth()
+{
+  DBL Rays_Per_Pixel;
+
+  if (Render_Statistics.Pixels <= 1)
+  {
+    return;
+  }
+
+  Rays_Per_Pixel = (DBL)Render_Statistics.Rays / (DBL)(Render_Statistics.Pixels - 1);
+
+  if ((Rays_Per_Pixel > opts.Ray_Budget) && (Trace_Depth_Limit > 2))
+  {
+    Trace_Depth_Limit--;
+  }
+  else if ((Rays_Per_Pixel < 0.75 * opts.Ray_Budget) && (Trace_Depth_Limit < Max_Trace_Level))
+  {
+    Trace_Depth_Limit++;
+  }
+
+  Render_Statistics.Lowest_Depth_Limit = min(Render_Statistics.Lowest_Depth_Limit, Trace_Depth_Limit);
+}
+
+
+
 /*****************************************************************************
 *
 * FUNCTION
@@ -2598,6 +3303,16 @@ void trace_pixel(int x, int y, COLOUR ColourClipped, COLOUR ColourUnclipped)
 {
   Increase_Counter(stats[Number_Of_Pixels]);
 
+  /* @CoppeliaSim@ */
+  Render_Statistics.Pixels++;
+
+  if ((opts.Ray_Budget > 0.0) && (y != Trace_Budget_Line))
+  {
+    adapt_trace_depth();
+
+    Trace_Budget_Line = y;
+  }
+
   Trace_Level = 1;
   In_Reflection_Ray = false; /* Object-Ray Options [$ENB 9/97] */
   In_Shadow_Ray = false; /* Object-Ray Options */
@@ -2630,7 +3345,16 @@ void trace_pixel(int x, int y, COLOUR ColourClipped, COLOUR ColourUnclipped)
       }
       else
       {
+        /* @CoppeliaSim@ */
+        if (opts.Options & USE_RASTER_BUFFER)
+        {
+          Raster_Pixel_X = x;
+          Raster_Pixel_Y = y;
+        }
+
         Trace(&Camera_Ray, ColourUnclipped, 1.0);
+
+        Raster_Pixel_Y = -1;
       }
     }
     else
@@ -3339,6 +4063,31 @@ static int create_ray(RAY *Ray, DBL x, DBL  y, int ray_number)
   }
   
   VNormalize(Ray->Direction, Ray->Direction);
+
+  /* Move the ray origin to the near plane and limit its depth to the far plane. */
+
+  if (View_Clipping_Is_Used)
+  {
+    DBL cos_view, near_depth;
+
+    VDot(cos_view, Ray->Direction, View_Axis);
+
+    if (cos_view > EPSILON)
+    {
+      near_depth = Frame.Camera->Near_Distance / cos_view;
+
+      VAddScaledEq(Ray->Initial, near_depth, Ray->Direction);
+
+      if (Frame.Camera->Far_Distance > Frame.Camera->Near_Distance)
+        Primary_Ray_Max_Depth = Frame.Camera->Far_Distance / cos_view - near_depth;
+      else
+        Primary_Ray_Max_Depth = BOUND_HUGE;
+    }
+    else
+    {
+      Primary_Ray_Max_Depth = BOUND_HUGE;
+    }
+  }
   
   return(true);
 
@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 
 #ifndef RENDER_H
 #define RENDER_H
@@ -75,6 +81,10 @@ extern int Trace_Level, Max_Trace_Level, Highest_Trace_Level;
 extern bool Had_Max_Trace_Level;
 extern DBL Total_Depth;
 
+/* @CoppeliaSim@ */
+/* Ray footprint at distance d from the camera: Pixel_Footprint_Width + Pixel_Footprint_Angle * d. */
+extern DBL Pixel_Footprint_Width, Pixel_Footprint_Angle;
+
 /* Object-Ray Options [ENB 9/97] */
 extern bool In_Reflection_Ray;
 extern bool In_Shadow_Ray;
@@ -731,6 +731,19 @@ void output_single_image_line_with_alpha_correction(COLOUR *Line, int y)
   if (Display_Started)
   {
     POV_DISPLAY_PLOT_ROW(opts.Preview_RefCon, Frame.Screen_Width, y, opts.First_Column, opts.Last_Column, Red_Row_255, Green_Row_255, Blue_Row_255, Alpha_Row_255);
+
+    /* @CoppeliaSim@ */
+    if (Render_Progress_Callback != NULL)
+    {
+      RENDER_REGION Finished;
+
+      Finished.First_Column = opts.First_Column;
+      Finished.First_Line = y;
+      Finished.Last_Column = opts.Last_Column;
+      Finished.Last_Line = y + 1;
+
+      (*Render_Progress_Callback)(Render_Progress_Data, &Finished);
+    }
   }
 
   POV_WRITE_LINE (Line, y)
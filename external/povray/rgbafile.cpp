@@ -42,6 +42,7 @@
 #include "frame.h"
 #include "povray.h"
 #include "rgbafile.h"
+#include "image.h"
 #include "pov_util.h"
 #include "povmsend.h"
 #include "colour.h"
@@ -135,6 +136,10 @@ void Read_RGBA_Image (IMAGE *Image)
   /* Close the image file */
 
     POV_FREE (row);
+
+  /* Tile the image and build its mip chain for filtered lookups */
+
+  Build_Image_Mip_Chain (Image);
 }
 
 END_POV_NAMESPACE
@@ -33,6 +33,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 /*
    Some texture ideas garnered from SIGGRAPH '85 Volume 19 Number 3, 
    "An Image Synthesizer" By Ken Perlin.
@@ -1292,6 +1298,53 @@ TEXTURE *Copy_Texture_Pointer(TEXTURE *Texture)
 
 
 
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Unshare_Textures
+*
+* INPUT
+*
+*   Textures - texture that is about to be modified
+*
+* OUTPUT
+*
+* RETURNS
+*
+*   TEXTURE * - texture owned by the caller alone
+*
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Texture identifiers are shared by reference. Before a shared texture is
+*   transformed or layered, replace the caller's reference by a copy.
+*
+* CHANGES
+*
+******************************************************************************/
+
+TEXTURE *Unshare_Textures(TEXTURE *Textures)
+{
+  TEXTURE *New;
+
+  if ((Textures == NULL) || (Textures->References <= 1))
+  {
+    return(Textures);
+  }
+
+  New = Copy_Textures(Textures);
+
+  Destroy_Textures(Textures);
+
+  return(New);
+}
+
+
+
 
 /*****************************************************************************
 *
@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 /* NOTE: FRAME.H contains other texture stuff. */
 
 #ifndef TEXTURE_H
@@ -98,6 +104,7 @@ FINISH *Create_Finish (void);
 FINISH *Copy_Finish (FINISH *Old);
 TEXTURE *Create_PNF_Texture (void);
 TEXTURE *Copy_Texture_Pointer (TEXTURE *Texture);
+TEXTURE *Unshare_Textures (TEXTURE *Textures); /* @CoppeliaSim@ */
 TEXTURE *Copy_Textures (TEXTURE *Textures);
 TEXTURE *Create_Texture (void);
 int Test_Opacity (TEXTURE *Texture);
@@ -721,7 +721,11 @@ const RESERVED_WORD Reserved_Words[LAST_TOKEN] = {
   {NO_BUMP_SCALE_TOKEN, "no_bump_scale"},
   {GLOBAL_LIGHTS_TOKEN, "global_lights"},
   {INTERNAL_TOKEN, "internal"},
-  {NOISE_GENERATOR_TOKEN, "noise_generator"}
+  {NOISE_GENERATOR_TOKEN, "noise_generator"},
+  /* @CoppeliaSim@ */
+  {NEAR_DISTANCE_TOKEN, "near_distance"},
+  {FAR_DISTANCE_TOKEN, "far_distance"},
+  {INDEXED_BLOCK_TOKEN, "indexed_block"}
 };
 
 
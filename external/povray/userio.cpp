@@ -152,6 +152,11 @@ int Debug_Info(const char *format,...)
     va_list marker;
     char localvsbuffer[1024];
 
+    /* @CoppeliaSim@ */
+    // Forked worker processes never call into the host application
+    if(Render_Worker_Process)
+        return 0;
+
     va_start(marker, format);
     vsnprintf(localvsbuffer, 1023, format, marker);
     va_end(marker);
@@ -173,6 +178,11 @@ int Warning(unsigned int level, const char *format,...)
     POVMSObject msg;
     char localvsbuffer[1024];
 
+    /* @CoppeliaSim@ */
+    // Forked worker processes never call into the host application
+    if(Render_Worker_Process)
+        return 0;
+
     sprintf(localvsbuffer, "%s Warning: ", Stage_Names[Stage].stage_name);
 
     va_start(marker, format);
@@ -222,6 +232,11 @@ int WarningAt(unsigned int level, const char *filename, long line, unsigned long
     POVMSObject msg;
     char localvsbuffer[1024];
 
+    /* @CoppeliaSim@ */
+    // Forked worker processes never call into the host application
+    if(Render_Worker_Process)
+        return 0;
+
     sprintf(localvsbuffer, "%s Warning: ", Stage_Names[Stage].stage_name);
 
     va_start(marker, format);
@@ -261,6 +276,11 @@ int PossibleError(const char *format,...)
     POVMSObject msg;
     char localvsbuffer[1024];
 
+    /* @CoppeliaSim@ */
+    // Forked worker processes never call into the host application
+    if(Render_Worker_Process)
+        return 0;
+
     sprintf(localvsbuffer, "Possible %s Error: ", Stage_Names[Stage].stage_name);
 
     va_start(marker, format);
@@ -307,6 +327,11 @@ int Error(const char *format,...)
     POVMSObject msg;
     char localvsbuffer[1024];
 
+    /* @CoppeliaSim@ */
+    // A forked worker process leaves at once, its tiles are traced again by the calling process
+    if(Render_Worker_Process)
+        povray_exit(1);
+
     sprintf(localvsbuffer, "%s Error: ", Stage_Names[Stage].stage_name);
 
     va_start(marker, format);
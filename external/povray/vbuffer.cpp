@@ -31,16 +31,25 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 #include "frame.h"
 #include "vector.h"
 #include "povray.h"
 #include "bbox.h"
 #include "boxes.h"
+#include "camera.h"
 #include "hfield.h"
 #include "lightgrp.h"
 #include "lighting.h"
 #include "matrices.h"
+#include "mesh.h"
 #include "objects.h"
+#include "point.h"
 #include "render.h"
 #include "triangle.h"
 #include "vbuffer.h"
@@ -53,6 +62,13 @@
 
 #include <algorithm>
 
+/* @CoppeliaSim@ */
+#if defined(__linux)
+#include <unistd.h>
+#include <pthread.h>
+#define POV_THREADED_RASTER 1
+#endif
+
 BEGIN_POV_NAMESPACE
 
 /*****************************************************************************
@@ -67,12 +83,49 @@ extern PROJECT_QUEUE *Node_Queue; // GLOBAL VARIABLE
 * Local preprocessor defines
 ******************************************************************************/
 
+/* @CoppeliaSim@ */
+/* Raster buffer entries which are not an index into Raster_Objects. */
+
+const int RASTER_EMPTY     = -1; /* no rasterized mesh covers the pixel centre */
+const int RASTER_AMBIGUOUS = -2; /* intersect the ray with all objects */
+
+/* Distance (in pixels) to a triangle edge below which a pixel centre is ambiguous. */
+
+const DBL RASTER_EDGE_TOLERANCE = 0.01;
+
+/* Relative depth difference below which two objects' triangles are ambiguous. */
+
+const DBL RASTER_DEPTH_TOLERANCE = 1.0e-5;
+
+/* Most objects intersected by every primary ray for the raster buffer to be used. */
+
+const int RASTER_MAX_OTHERS = 16;
+
 
 
 /*****************************************************************************
 * Local typedefs
 ******************************************************************************/
 
+/* @CoppeliaSim@ */
+/* Mesh vertex projected to the screen: pixel coordinates and depth key. */
+
+typedef struct Raster_Vertex_Struct RASTER_VERTEX;
+
+struct Raster_Vertex_Struct
+{
+  DBL x, y, Key;
+};
+
+/* Lines rasterized by a thread. */
+
+typedef struct Raster_Band_Struct RASTER_BAND;
+
+struct Raster_Band_Struct
+{
+  int First_Line, Last_Line;
+};
+
 
 
 /*****************************************************************************
@@ -97,6 +150,39 @@ const DBL VIEW_DY2 = 0.4472135955;
 
 static PROJECT_TREE_NODE *Root_Vista; // GLOBAL VARIABLE
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// @CoppeliaSim@                                                                   //
+//                                                                           //
+// Raster buffer: first-hit visibility of meshes for primary rays through    //
+// pixel centres, see Build_Raster_Buffer                                    //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+/* Meshes which are rasterized. */
+
+static OBJECT **Raster_Objects; // GLOBAL VARIABLE
+static int Raster_Number_Of_Objects; // GLOBAL VARIABLE
+
+/* Other objects, intersected by every primary ray. */
+
+static OBJECT **Raster_Others; // GLOBAL VARIABLE
+static int Raster_Number_Of_Others; // GLOBAL VARIABLE
+
+/* Projected vertices of the rasterized meshes. */
+
+static RASTER_VERTEX *Raster_Vertices; // GLOBAL VARIABLE
+static long *Raster_First_Vertex; // GLOBAL VARIABLE
+
+/* Rows of the inverted camera matrix [Right Up Direction]. */
+
+static VECTOR Raster_Right, Raster_Up, Raster_Direction; // GLOBAL VARIABLE
+
+/* Per pixel: object index and depth keys of the nearest triangles. */
+
+static int *Raster_Index; // GLOBAL VARIABLE
+static DBL *Raster_Key, *Raster_Edge_Key; // GLOBAL VARIABLE
+
 
 /*****************************************************************************
 * Static functions
@@ -129,6 +215,13 @@ static int intersect_vista_tree (RAY *Ray, PROJECT_TREE_NODE *Tree, int x, INTER
 static void draw_projection (PROJECT *Project, int color, int *BigRed, int *BigBlue);
 static void draw_vista (PROJECT_TREE_NODE *Tree, int *BigRed, int *BigBlue);
 
+/* @CoppeliaSim@ */
+static bool project_raster_mesh (OBJECT *Object, RASTER_VERTEX *Vertices);
+static void rasterize_lines (int First_Line, int Last_Line);
+#ifdef POV_THREADED_RASTER
+static void *rasterize_band (void *Band);
+#endif
+
 /*****************************************************************************
 *
 * FUNCTION
@@ -1774,6 +1867,672 @@ void Destroy_Vista_Buffer()
 
 
 
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Build_Raster_Buffer
+*
+* INPUT
+*   
+* OUTPUT
+*   
+* RETURNS
+*   
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Rasterize the triangles of all meshes in front of the near plane into
+*   a buffer telling for each pixel centre which mesh a primary ray hits
+*   first. Pixel centres lying on a triangle edge, or where triangles of
+*   different objects have nearly the same depth, are marked ambiguous,
+*   and their rays are intersected with all objects. Other objects are
+*   intersected by every primary ray, so the buffer is only used if there
+*   are few of them.
+*
+*   This only works for perspective and orthographic cameras. The lines
+*   are rasterized in parallel bands where threads are available.
+*
+* CHANGES
+*
+******************************************************************************/
+
+void Build_Raster_Buffer()
+{
+  int i, n, workers;
+  long Number_Of_Vertices;
+  size_t size;
+  DBL det;
+  OBJECT *Object;
+
+  Raster_Objects = NULL;
+  Raster_Others = NULL;
+  Raster_Vertices = NULL;
+  Raster_First_Vertex = NULL;
+  Raster_Index = NULL;
+  Raster_Key = NULL;
+  Raster_Edge_Key = NULL;
+
+  Raster_Number_Of_Objects = 0;
+  Raster_Number_Of_Others = 0;
+
+  /* Check if raster buffer can be used. */
+
+  if ((Frame.Camera->Tnormal != NULL) ||
+      ((Frame.Camera->Type != PERSPECTIVE_CAMERA) && (Frame.Camera->Type != ORTHOGRAPHIC_CAMERA)) ||
+      ((Frame.Camera->Aperture != 0.0) && (Frame.Camera->Blur_Samples > 0)))
+  {
+    opts.Options &= ~USE_RASTER_BUFFER;
+  }
+
+  if (!(opts.Options & USE_RASTER_BUFFER))
+  {
+    return;
+  }
+
+  /* Invert the camera matrix [Right Up Direction]. */
+
+  VCross(Raster_Right, Frame.Camera->Up, Frame.Camera->Direction);
+  VCross(Raster_Up, Frame.Camera->Direction, Frame.Camera->Right);
+  VCross(Raster_Direction, Frame.Camera->Right, Frame.Camera->Up);
+
+  VDot(det, Frame.Camera->Right, Raster_Right);
+
+  if (fabs(det) < EPSILON)
+  {
+    opts.Options &= ~USE_RASTER_BUFFER;
+
+    return;
+  }
+
+  VInverseScaleEq(Raster_Right, det);
+  VInverseScaleEq(Raster_Up, det);
+  VInverseScaleEq(Raster_Direction, det);
+
+  /* Sort the objects seen by primary rays into meshes and others. */
+
+  n = 0;
+  Number_Of_Vertices = 0;
+
+  for (Object = Frame.Objects; Object != NULL; Object = Object->Sibling)
+  {
+    n++;
+
+    if (Object->Methods == &Mesh_Methods)
+    {
+      Number_Of_Vertices += ((MESH *)Object)->Data->Number_Of_Vertices;
+    }
+  }
+
+  Raster_Objects = (OBJECT **)POV_MALLOC((n + 1) * sizeof(OBJECT *), "raster buffer objects");
+  Raster_Others = (OBJECT **)POV_MALLOC((n + 1) * sizeof(OBJECT *), "raster buffer objects");
+  Raster_First_Vertex = (long *)POV_MALLOC((n + 1) * sizeof(long), "raster buffer vertices");
+  Raster_Vertices = (RASTER_VERTEX *)POV_MALLOC((Number_Of_Vertices + 1) * sizeof(RASTER_VERTEX), "raster buffer vertices");
+
+  Raster_First_Vertex[0] = 0;
+
+  for (Object = Frame.Objects; Object != NULL; Object = Object->Sibling)
+  {
+    if (Test_Flag(Object, NO_IMAGE_FLAG))
+    {
+      continue;
+    }
+
+    if ((Object->Methods == &Light_Source_Methods) && (((LIGHT_SOURCE *)Object)->Children == NULL))
+    {
+      continue;
+    }
+
+    if ((Object->Methods == &Mesh_Methods) && (Object->Clip == NULL) && (Object->Bound == NULL) &&
+        project_raster_mesh(Object, &Raster_Vertices[Raster_First_Vertex[Raster_Number_Of_Objects]]))
+    {
+      i = Raster_Number_Of_Objects++;
+
+      Raster_Objects[i] = Object;
+
+      Raster_First_Vertex[i + 1] = Raster_First_Vertex[i] + ((MESH *)Object)->Data->Number_Of_Vertices;
+    }
+    else
+    {
+      Raster_Others[Raster_Number_Of_Others++] = Object;
+    }
+  }
+
+  if ((Raster_Number_Of_Objects == 0) || (Raster_Number_Of_Others > RASTER_MAX_OTHERS))
+  {
+    Destroy_Raster_Buffer();
+
+    opts.Options &= ~USE_RASTER_BUFFER;
+
+    return;
+  }
+
+  size = (size_t)Frame.Screen_Width * (size_t)Frame.Screen_Height;
+
+  Raster_Index = (int *)POV_MALLOC(size * sizeof(int), "raster buffer");
+  Raster_Key = (DBL *)POV_MALLOC(size * sizeof(DBL), "raster buffer");
+  Raster_Edge_Key = (DBL *)POV_MALLOC(size * sizeof(DBL), "raster buffer");
+
+  for (i = 0; i < (int)size; i++)
+  {
+    Raster_Index[i] = RASTER_AMBIGUOUS;
+  }
+
+  /* Rasterize the lines to be traced. */
+
+  workers = 1;
+
+#ifdef POV_THREADED_RASTER
+  workers = opts.Render_Workers;
+
+  if (workers <= 0)
+  {
+    workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  workers = max(1, min(workers, opts.Last_Line - opts.First_Line));
+
+  if (workers > 1)
+  {
+    RASTER_BAND *Bands;
+    pthread_t *Threads;
+    bool *Started;
+
+    Bands = (RASTER_BAND *)POV_MALLOC(workers * sizeof(RASTER_BAND), "raster buffer threads");
+    Threads = (pthread_t *)POV_MALLOC(workers * sizeof(pthread_t), "raster buffer threads");
+    Started = (bool *)POV_MALLOC(workers * sizeof(bool), "raster buffer threads");
+
+    for (i = 0; i < workers; i++)
+    {
+      Bands[i].First_Line = opts.First_Line + (opts.Last_Line - opts.First_Line) * i / workers;
+      Bands[i].Last_Line = opts.First_Line + (opts.Last_Line - opts.First_Line) * (i + 1) / workers;
+
+      Started[i] = (pthread_create(&Threads[i], NULL, rasterize_band, &Bands[i]) == 0);
+    }
+
+    /* Bands of threads which could not be started are done here. */
+
+    for (i = 0; i < workers; i++)
+    {
+      if (Started[i])
+      {
+        pthread_join(Threads[i], NULL);
+      }
+      else
+      {
+        rasterize_lines(Bands[i].First_Line, Bands[i].Last_Line);
+      }
+    }
+
+    POV_FREE(Started);
+    POV_FREE(Threads);
+    POV_FREE(Bands);
+  }
+#endif
+
+  if (workers <= 1)
+  {
+    rasterize_lines(opts.First_Line, opts.Last_Line);
+  }
+
+  /* Only the object indices are needed while tracing. */
+
+  POV_FREE(Raster_Edge_Key);
+  POV_FREE(Raster_Key);
+  POV_FREE(Raster_Vertices);
+  POV_FREE(Raster_First_Vertex);
+
+  Raster_Edge_Key = NULL;
+  Raster_Key = NULL;
+  Raster_Vertices = NULL;
+  Raster_First_Vertex = NULL;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Destroy_Raster_Buffer
+*
+* INPUT
+*   
+* OUTPUT
+*   
+* RETURNS
+*   
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Destroy the raster buffer.
+*
+* CHANGES
+*
+******************************************************************************/
+
+void Destroy_Raster_Buffer()
+{
+  if (Raster_Objects != NULL)
+    POV_FREE(Raster_Objects);
+  if (Raster_Others != NULL)
+    POV_FREE(Raster_Others);
+  if (Raster_Vertices != NULL)
+    POV_FREE(Raster_Vertices);
+  if (Raster_First_Vertex != NULL)
+    POV_FREE(Raster_First_Vertex);
+  if (Raster_Index != NULL)
+    POV_FREE(Raster_Index);
+  if (Raster_Key != NULL)
+    POV_FREE(Raster_Key);
+  if (Raster_Edge_Key != NULL)
+    POV_FREE(Raster_Edge_Key);
+
+  Raster_Objects = NULL;
+  Raster_Others = NULL;
+  Raster_Vertices = NULL;
+  Raster_First_Vertex = NULL;
+  Raster_Index = NULL;
+  Raster_Key = NULL;
+  Raster_Edge_Key = NULL;
+
+  Raster_Number_Of_Objects = 0;
+  Raster_Number_Of_Others = 0;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   Intersect_Raster_Buffer
+*
+* INPUT
+*
+*   Ray               - Primary ray through a pixel centre
+*   x, y              - Pixel
+*   Best_Intersection - Intersection found
+*   
+* OUTPUT
+*
+*   Best_Intersection
+*   
+* RETURNS
+*
+*   int - true if an object was hit, false if not, -1 if the raster buffer
+*         cannot tell and the ray has to be intersected with all objects
+*   
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Intersect a primary ray with the mesh the raster buffer found at its
+*   pixel and with the objects which are not rasterized. Ambiguous pixels
+*   and rays missing the mesh are left to the caller.
+*
+* CHANGES
+*
+******************************************************************************/
+
+int Intersect_Raster_Buffer(RAY *Ray, int x, int y, INTERSECTION *Best_Intersection)
+{
+  int i, Index, Found;
+  OBJECT *Object;
+  INTERSECTION New_Intersection;
+
+  if ((Raster_Index == NULL) || (x < 0) || (x >= Frame.Screen_Width) || (y < 0) || (y >= Frame.Screen_Height))
+  {
+    return -1;
+  }
+
+  Index = Raster_Index[(size_t)y * Frame.Screen_Width + x];
+
+  if (Index == RASTER_AMBIGUOUS)
+  {
+    return -1;
+  }
+
+  Found = false;
+
+  if (Index >= 0)
+  {
+    if (!Intersection(&New_Intersection, Raster_Objects[Index], Ray))
+    {
+      return -1;
+    }
+
+    *Best_Intersection = New_Intersection;
+
+    Found = true;
+  }
+
+  for (i = 0; i < Raster_Number_Of_Others; i++)
+  {
+    Object = Raster_Others[i];
+
+    if (TEST_RAY_FLAGS(Object) && Intersection(&New_Intersection, Object, Ray))
+    {
+      if (New_Intersection.Depth < Best_Intersection->Depth)
+      {
+        *Best_Intersection = New_Intersection;
+
+        Found = true;
+      }
+    }
+  }
+
+  return Found;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   project_raster_mesh
+*
+* INPUT
+*
+*   Object   - Mesh to project
+*   Vertices - Projected vertices
+*   
+* OUTPUT
+*
+*   Vertices
+*   
+* RETURNS
+*
+*   bool - false if a vertex is not in front of the near plane
+*   
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Project the vertices of a mesh to pixel coordinates, matching the
+*   pixel centres of primary rays. The depth key grows towards the viewer
+*   and varies linearly across a projected triangle: it is the inverse of
+*   the depth for perspective cameras and the negated depth otherwise.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static bool project_raster_mesh(OBJECT *Object, RASTER_VERTEX *Vertices)
+{
+  long i;
+  DBL a, b, c, Depth, Near, Offset;
+  VECTOR P, View_Axis;
+  MESH *Mesh = (MESH *)Object;
+
+  VNormalize(View_Axis, Frame.Camera->Direction);
+
+  Near = max(Frame.Camera->Near_Distance, EPSILON);
+
+  /* Primary rays go through pixel centres since version 3.5. */
+
+  Offset = (opts.Language_Version >= 350) ? 0.5 : 0.0;
+
+  for (i = 0; i < Mesh->Data->Number_Of_Vertices; i++)
+  {
+    Assign_Vector(P, Mesh->Data->Vertices[i]);
+
+    if (Mesh->Trans != NULL)
+    {
+      MTransPoint(P, P, Mesh->Trans);
+    }
+
+    VSubEq(P, Frame.Camera->Location);
+
+    VDot(a, P, Raster_Right);
+    VDot(b, P, Raster_Up);
+    VDot(c, P, Raster_Direction);
+
+    /* Depth along the view axis, as used by view clipping. */
+
+    VDot(Depth, P, View_Axis);
+
+    if ((Depth <= Near) || (c <= EPSILON))
+    {
+      return false;
+    }
+
+    if (Frame.Camera->Type == PERSPECTIVE_CAMERA)
+    {
+      a /= c;
+      b /= c;
+
+      Vertices[i].Key = 1.0 / c;
+    }
+    else
+    {
+      Vertices[i].Key = -c;
+    }
+
+    Vertices[i].x = (a + 0.5) * Frame.Screen_Width - Offset;
+    Vertices[i].y = (DBL)(Frame.Screen_Height - 1) - (b + 0.5) * Frame.Screen_Height + Offset;
+  }
+
+  return true;
+}
+
+
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   rasterize_lines
+*
+* INPUT
+*
+*   First_Line, Last_Line - Lines to rasterize
+*   
+* OUTPUT
+*   
+* RETURNS
+*   
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Rasterize all mesh triangles into the given lines of the raster
+*   buffer, keeping the nearest object whose triangle covers the pixel
+*   centre, then mark pixels ambiguous where a triangle edge at least as
+*   near passes the centre or another object is nearly as near.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void rasterize_lines(int First_Line, int Last_Line)
+{
+  int k, x, y, x_min, x_max, y_min, y_max;
+  long t, Number_Of_Triangles;
+  size_t p;
+  DBL Area, Sign, L1, L2, L3, W1, W2, W3, Key, Tolerance;
+  RASTER_VERTEX *Vertices, *V1, *V2, *V3;
+  MESH_TRIANGLE *Triangle;
+  MESH *Mesh;
+
+  for (y = First_Line; y < Last_Line; y++)
+  {
+    for (x = opts.First_Column; x < opts.Last_Column; x++)
+    {
+      p = (size_t)y * Frame.Screen_Width + x;
+
+      Raster_Index[p] = RASTER_EMPTY;
+      Raster_Key[p] = -BOUND_HUGE;
+      Raster_Edge_Key[p] = -BOUND_HUGE;
+    }
+  }
+
+  for (k = 0; k < Raster_Number_Of_Objects; k++)
+  {
+    Mesh = (MESH *)Raster_Objects[k];
+
+    Vertices = &Raster_Vertices[Raster_First_Vertex[k]];
+
+    Triangle = Mesh->Data->Triangles;
+
+    Number_Of_Triangles = Mesh->Data->Number_Of_Triangles;
+
+    for (t = 0; t < Number_Of_Triangles; t++, Triangle++)
+    {
+      V1 = &Vertices[Triangle->P1];
+      V2 = &Vertices[Triangle->P2];
+      V3 = &Vertices[Triangle->P3];
+
+      y_min = max(First_Line, (int)ceil(min(V1->y, min(V2->y, V3->y)) - RASTER_EDGE_TOLERANCE));
+      y_max = min(Last_Line - 1, (int)floor(max(V1->y, max(V2->y, V3->y)) + RASTER_EDGE_TOLERANCE));
+
+      if (y_min > y_max)
+      {
+        continue;
+      }
+
+      x_min = max(opts.First_Column, (int)ceil(min(V1->x, min(V2->x, V3->x)) - RASTER_EDGE_TOLERANCE));
+      x_max = min(opts.Last_Column - 1, (int)floor(max(V1->x, max(V2->x, V3->x)) + RASTER_EDGE_TOLERANCE));
+
+      if (x_min > x_max)
+      {
+        continue;
+      }
+
+      /* Triangles seen edge-on cover no pixel centre. */
+
+      Area = (V2->x - V1->x) * (V3->y - V1->y) - (V2->y - V1->y) * (V3->x - V1->x);
+
+      if (fabs(Area) < EPSILON)
+      {
+        continue;
+      }
+
+      Sign = (Area > 0.0) ? 1.0 : -1.0;
+
+      L1 = sqrt(Sqr(V3->x - V2->x) + Sqr(V3->y - V2->y));
+      L2 = sqrt(Sqr(V1->x - V3->x) + Sqr(V1->y - V3->y));
+      L3 = sqrt(Sqr(V2->x - V1->x) + Sqr(V2->y - V1->y));
+
+      for (y = y_min; y <= y_max; y++)
+      {
+        for (x = x_min; x <= x_max; x++)
+        {
+          /* Edge functions, W1 is zero on the edge opposite to V1. */
+
+          W1 = Sign * ((V3->x - V2->x) * (y - V2->y) - (V3->y - V2->y) * (x - V2->x));
+          W2 = Sign * ((V1->x - V3->x) * (y - V3->y) - (V1->y - V3->y) * (x - V3->x));
+          W3 = Sign * ((V2->x - V1->x) * (y - V1->y) - (V2->y - V1->y) * (x - V1->x));
+
+          if ((W1 < -RASTER_EDGE_TOLERANCE * L1) ||
+              (W2 < -RASTER_EDGE_TOLERANCE * L2) ||
+              (W3 < -RASTER_EDGE_TOLERANCE * L3))
+          {
+            continue;
+          }
+
+          p = (size_t)y * Frame.Screen_Width + x;
+
+          Key = (W1 * V1->Key + W2 * V2->Key + W3 * V3->Key) / (Sign * Area);
+
+          if ((W1 <= RASTER_EDGE_TOLERANCE * L1) ||
+              (W2 <= RASTER_EDGE_TOLERANCE * L2) ||
+              (W3 <= RASTER_EDGE_TOLERANCE * L3))
+          {
+            Raster_Edge_Key[p] = max(Raster_Edge_Key[p], Key);
+
+            continue;
+          }
+
+          if ((Raster_Index[p] >= 0) && (Raster_Index[p] != k))
+          {
+            Tolerance = RASTER_DEPTH_TOLERANCE * max(fabs(Key), fabs(Raster_Key[p]));
+
+            if (fabs(Key - Raster_Key[p]) <= Tolerance)
+            {
+              Raster_Edge_Key[p] = BOUND_HUGE;
+            }
+          }
+
+          if (Key > Raster_Key[p])
+          {
+            Raster_Index[p] = k;
+            Raster_Key[p] = Key;
+          }
+        }
+      }
+    }
+  }
+
+  for (y = First_Line; y < Last_Line; y++)
+  {
+    for (x = opts.First_Column; x < opts.Last_Column; x++)
+    {
+      p = (size_t)y * Frame.Screen_Width + x;
+
+      if ((Raster_Edge_Key[p] > -BOUND_HUGE) &&
+          (Raster_Edge_Key[p] >= Raster_Key[p] - RASTER_DEPTH_TOLERANCE * fabs(Raster_Key[p])))
+      {
+        Raster_Index[p] = RASTER_AMBIGUOUS;
+      }
+    }
+  }
+}
+
+
+
+#ifdef POV_THREADED_RASTER
+
+/*****************************************************************************
+*
+* FUNCTION
+*
+*   rasterize_band
+*
+* INPUT
+*
+*   Band - Lines to rasterize
+*   
+* OUTPUT
+*   
+* RETURNS
+*   
+* AUTHOR
+*
+* DESCRIPTION
+*
+*   @CoppeliaSim@
+*
+*   Thread entry point rasterizing a band of lines.
+*
+* CHANGES
+*
+******************************************************************************/
+
+static void *rasterize_band(void *Band)
+{
+  rasterize_lines(((RASTER_BAND *)Band)->First_Line, ((RASTER_BAND *)Band)->Last_Line);
+
+  return NULL;
+}
+
+#endif
+
+
+
 /*****************************************************************************
 *
 * FUNCTION
@@ -29,6 +29,12 @@
  * $Log$
  *****************************************************************************/
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Modified for the CoppeliaSim Ray-Tracer Plugin (see @CoppeliaSim@ for changes)        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
 
 #ifndef VBUFFER_H
 #define VBUFFER_H
@@ -67,6 +73,11 @@ void Build_Vista_Buffer (void);
 void Destroy_Vista_Buffer (void);
 void Draw_Vista_Buffer (void);
 
+/* @CoppeliaSim@ */
+void Build_Raster_Buffer (void);
+void Destroy_Raster_Buffer (void);
+int Intersect_Raster_Buffer (RAY *Ray, int x, int y, INTERSECTION *Best_Intersection);
+
 END_POV_NAMESPACE
 
 #endif
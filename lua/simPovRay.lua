@@ -1,3 +1,35 @@
 local simPovRay = loadPlugin('simPovRay');
 
+simPovRay.settingNames = {'quality', 'antialias', 'aaThreshold', 'aaDepth', 'traceDepth', 'areaLightSamples', 'threads', 'rasterize', 'lodPixels', 'roulette', 'rayBudget', 'shareScene', 'keepFrame'}
+
+-- Get all render settings of a vision sensor as a table
+function simPovRay.getSettings(sensorHandle)
+    local settings = {}
+    for _, name in ipairs(simPovRay.settingNames) do
+        settings[name] = simPovRay.getSetting(sensorHandle, name)
+    end
+    settings.antialias = (settings.antialias ~= 0)
+    settings.rasterize = (settings.rasterize ~= 0)
+    settings.shareScene = (settings.shareScene ~= 0)
+    settings.keepFrame = (settings.keepFrame ~= 0)
+    return settings
+end
+
+-- Set the render settings of a vision sensor given in a table, optionally on top of a preset
+-- ('default', 'draft', 'fast' or 'final')
+function simPovRay.setSettings(sensorHandle, settings, preset)
+    if preset then
+        simPovRay.setPreset(sensorHandle, preset)
+    end
+    for _, name in ipairs(simPovRay.settingNames) do
+        local value = settings[name]
+        if type(value) == 'boolean' then
+            value = value and 1 or 0
+        end
+        if value ~= nil then
+            simPovRay.setSetting(sensorHandle, name, value)
+        end
+    end
+end
+
 return simPovRay
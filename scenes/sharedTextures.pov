@@ -0,0 +1,53 @@
+// Regression scene for textures declared once and shared between meshes, as the
+// plugin writes them (SimTextureN): each mesh layers an image-like texture over a
+// shared base and applies its own matrix. Destroying the first mesh must not free
+// the base the others still use, and the matrix of one mesh must not move the
+// pattern of the others; the render must match the same scene with the base
+// textures written inline in every mesh.
+
+global_settings {ambient_light rgb <0.2,0.2,0.2>}
+background {rgb <0.1,0.1,0.3>}
+camera {perspective location <0,0,-6> right <1.33,0,0> up <0,1,0> look_at <0,0,0>}
+light_source {<3,5,-5> rgb <1,1,1>}
+#declare SimTexture0 = texture {pigment {rgbt <0.8,0.2,0.2,0>} finish {ambient 1 diffuse 1}}
+#declare SimTexture1 = texture {pigment {checker rgb <1,1,1> rgb <0,0,0> scale 0.25} finish {ambient 1 diffuse 1}}
+mesh2 {
+  vertex_vectors {4, <-1,-1,0>, <1,-1,0>, <1,1,0>, <-1,1,0>}
+  uv_vectors {4, <0,0>, <1,0>, <1,1>, <0,1>}
+  face_indices {2, <0,1,2>, <0,2,3>}
+  texture {SimTexture0}
+  texture {uv_mapping pigment {checker rgbt <0,0,1,0> rgbt <0,0,0,1> scale 0.5}}
+  matrix <1,0,0,0,1,0,0,0,1,-2.2,0.6,0>
+}
+mesh2 {
+  vertex_vectors {4, <-1,-1,0>, <1,-1,0>, <1,1,0>, <-1,1,0>}
+  uv_vectors {4, <0,0>, <1,0>, <1,1>, <0,1>}
+  face_indices {2, <0,1,2>, <0,2,3>}
+  texture {SimTexture0}
+  texture {uv_mapping pigment {checker rgbt <0,0,1,0> rgbt <0,0,0,1> scale 0.5}}
+  matrix <1,0,0,0,1,0,0,0,1,0,0.6,0>
+}
+mesh2 {
+  vertex_vectors {4, <-1,-1,0>, <1,-1,0>, <1,1,0>, <-1,1,0>}
+  uv_vectors {4, <0,0>, <1,0>, <1,1>, <0,1>}
+  face_indices {2, <0,1,2>, <0,2,3>}
+  texture {SimTexture0}
+  texture {uv_mapping pigment {checker rgbt <0,0,1,0> rgbt <0,0,0,1> scale 0.5}}
+  matrix <1,0,0,0,1,0,0,0,1,2.2,0.6,0>
+}
+mesh2 {
+  vertex_vectors {4, <-1,-1,0>, <1,-1,0>, <1,1,0>, <-1,1,0>}
+  uv_vectors {4, <0,0>, <1,0>, <1,1>, <0,1>}
+  face_indices {2, <0,1,2>, <0,2,3>}
+  texture {SimTexture1}
+  texture {uv_mapping pigment {checker rgbt <0,1,0,0> rgbt <0,0,0,1> scale 0.5}}
+  matrix <0.5,0,0,0,0.5,0,0,0,0.5,-1,-1.2,0>
+}
+mesh2 {
+  vertex_vectors {4, <-1,-1,0>, <1,-1,0>, <1,1,0>, <-1,1,0>}
+  uv_vectors {4, <0,0>, <1,0>, <1,1>, <0,1>}
+  face_indices {2, <0,1,2>, <0,2,3>}
+  texture {SimTexture1}
+  texture {uv_mapping pigment {checker rgbt <0,1,0,0> rgbt <0,0,0,1> scale 0.5}}
+  matrix <0.5,0,0,0,0.5,0,0,0,0.5,1,-1.2,0>
+}
@@ -19,6 +19,7 @@ macx {
 
 unix:!macx {
     DEFINES += LIN_SIM
+    LIBS += -lpthread
 }
 
 
@@ -57,6 +58,7 @@ INCLUDEPATH += external/povray/frontend
 
 SOURCES += \
     sourceCode/simPovRay.cpp \
+    sourceCode/meshDecimation.cpp \
     ../include/simLib/simLib.cpp \
     ../include/simMath/mathFuncs.cpp \
     ../include/simMath/3Vector.cpp \
@@ -159,6 +161,7 @@ SOURCES += \
 
 HEADERS +=\
     sourceCode/simPovRay.h \
+    sourceCode/meshDecimation.h \
     ../include/simLib/simLib.h \
     ../include/simMath/mathFuncs.h \
     ../include/simMath/mathDefines.h \
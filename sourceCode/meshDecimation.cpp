@@ -0,0 +1,387 @@
+#include <meshDecimation.h>
+#include <algorithm>
+#include <iterator>
+#include <queue>
+#include <math.h>
+
+// Weight of the planes holding open borders in place, relative to that of faces
+static const double boundaryWeight = 10.0;
+
+// Smallest cosine between a face's normals before and after a collapse
+static const double minFlipCosine = 0.2;
+
+// Sum of squared distances to a set of planes, as the symmetric 4x4 matrix
+// a0 a1 a2 a3 / a4 a5 a6 / a7 a8 / a9
+struct Quadric
+{
+    double a[10];
+
+    Quadric ()                              { for (int i = 0; i < 10; ++i) a[i] = 0; }
+
+    void addPlane (const double* n, double d, double w)
+    {
+        a[0] += w * n[0] * n[0]; a[1] += w * n[0] * n[1]; a[2] += w * n[0] * n[2]; a[3] += w * n[0] * d;
+        a[4] += w * n[1] * n[1]; a[5] += w * n[1] * n[2]; a[6] += w * n[1] * d;
+        a[7] += w * n[2] * n[2]; a[8] += w * n[2] * d;
+        a[9] += w * d * d;
+    }
+
+    void add (const Quadric& q)             { for (int i = 0; i < 10; ++i) a[i] += q.a[i]; }
+
+    double error (const double* p) const
+    {
+        return (a[0] * p[0] * p[0] + 2 * a[1] * p[0] * p[1] + 2 * a[2] * p[0] * p[2] +
+                a[4] * p[1] * p[1] + 2 * a[5] * p[1] * p[2] + a[7] * p[2] * p[2] +
+                2 * (a[3] * p[0] + a[6] * p[1] + a[8] * p[2]) + a[9]);
+    }
+
+    // Point of least error, if well defined
+    bool minimum (double* p) const
+    {
+        double c0 = a[4] * a[7] - a[5] * a[5];
+        double c1 = a[2] * a[5] - a[1] * a[7];
+        double c2 = a[1] * a[5] - a[2] * a[4];
+        double det = a[0] * c0 + a[1] * c1 + a[2] * c2;
+        double scale = std::max (a[0], std::max (a[4], a[7]));
+        if (fabs (det) <= 1e-9 * scale * scale * scale)
+            return false;
+        double b[3] = {-a[3], -a[6], -a[8]};
+        p[0] = (c0 * b[0] + c1 * b[1] + c2 * b[2]) / det;
+        p[1] = (c1 * b[0] + (a[0] * a[7] - a[2] * a[2]) * b[1] + (a[1] * a[2] - a[0] * a[5]) * b[2]) / det;
+        p[2] = (c2 * b[0] + (a[1] * a[2] - a[0] * a[5]) * b[1] + (a[0] * a[4] - a[1] * a[1]) * b[2]) / det;
+        return true;
+    }
+};
+
+// Candidate collapse of vertex v1 into v0 at position p; stale once either
+// vertex has changed since (stamp is the sum of their versions)
+struct Collapse
+{
+    double cost, p[3];
+    int v0, v1, stamp;
+
+    bool operator< (const Collapse& c) const { return cost > c.cost; }
+};
+
+static void faceNormal (const double* p0, const double* p1, const double* p2, double* n)
+{
+    double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+class Decimator
+{
+public:
+    Decimator (const float* vertices, const int* indices, int triangleCnt);
+    int run (const int* targets, int levelCnt, DecimatedMesh* levels);
+
+private:
+    std::vector<double> pos;
+    std::vector<Quadric> quadrics;
+    std::vector<int> faces;
+    std::vector<char> deadFace, deadVertex;
+    std::vector<int> version;
+    std::vector<std::vector<int> > vertexFaces;
+    std::priority_queue<Collapse> heap;
+    int live;
+
+    void push (int v0, int v1);
+    void neighbours (int v, std::vector<int>& n) const;
+    bool linked (int v0, int v1) const;
+    bool flips (int v, int other, const double* p) const;
+    void collapse (const Collapse& c);
+    void store (DecimatedMesh& level) const;
+};
+
+Decimator::Decimator (const float* vertices, const int* indices, int triangleCnt)
+{
+    int vertexCnt = 0;
+    for (int i = 0; i < triangleCnt * 3; ++i)
+        if (indices[i] >= vertexCnt)
+            vertexCnt = indices[i] + 1;
+
+    pos.assign (vertices, vertices + 3 * vertexCnt);
+    quadrics.resize (vertexCnt);
+    faces.assign (indices, indices + 3 * triangleCnt);
+    deadFace.assign (triangleCnt, 0);
+    deadVertex.assign (vertexCnt, 0);
+    version.assign (vertexCnt, 0);
+    vertexFaces.resize (vertexCnt);
+    live = triangleCnt;
+
+    // Face planes, weighted by area, and the edges of all faces
+    std::vector<std::pair<std::pair<int, int>, int> > edges;
+    edges.reserve (3 * triangleCnt);
+    for (int f = 0; f < triangleCnt; ++f)
+    {
+        const int* t = &faces[3 * f];
+        double n[3];
+        faceNormal (&pos[3 * t[0]], &pos[3 * t[1]], &pos[3 * t[2]], n);
+        double len = sqrt (n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len > 0)
+        {
+            n[0] /= len, n[1] /= len, n[2] /= len;
+            double d = -(n[0] * pos[3 * t[0]] + n[1] * pos[3 * t[0] + 1] + n[2] * pos[3 * t[0] + 2]);
+            for (int k = 0; k < 3; ++k)
+                quadrics[t[k]].addPlane (n, d, len / 2);
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            vertexFaces[t[k]].push_back (f);
+            int a = t[k], b = t[(k + 1) % 3];
+            edges.push_back (std::make_pair (std::make_pair (std::min (a, b), std::max (a, b)), f));
+        }
+    }
+
+    // Edges of a single face are borders: hold them with planes through the
+    // edge, perpendicular to the face
+    std::sort (edges.begin (), edges.end ());
+    for (size_t i = 0; i < edges.size (); )
+    {
+        size_t j = i + 1;
+        while (j < edges.size () && edges[j].first == edges[i].first)
+            ++j;
+        int a = edges[i].first.first, b = edges[i].first.second;
+        if (j == i + 1)
+        {
+            const int* t = &faces[3 * edges[i].second];
+            double n[3], e[3], m[3];
+            faceNormal (&pos[3 * t[0]], &pos[3 * t[1]], &pos[3 * t[2]], n);
+            for (int k = 0; k < 3; ++k)
+                e[k] = pos[3 * b + k] - pos[3 * a + k];
+            m[0] = e[1] * n[2] - e[2] * n[1];
+            m[1] = e[2] * n[0] - e[0] * n[2];
+            m[2] = e[0] * n[1] - e[1] * n[0];
+            double len = sqrt (m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+            if (len > 0)
+            {
+                m[0] /= len, m[1] /= len, m[2] /= len;
+                double d = -(m[0] * pos[3 * a] + m[1] * pos[3 * a + 1] + m[2] * pos[3 * a + 2]);
+                double w = boundaryWeight * (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+                quadrics[a].addPlane (m, d, w);
+                quadrics[b].addPlane (m, d, w);
+            }
+        }
+        i = j;
+    }
+
+    for (size_t i = 0; i < edges.size (); ++i)
+        if (i == 0 || edges[i].first != edges[i - 1].first)
+            push (edges[i].first.first, edges[i].first.second);
+}
+
+void Decimator::push (int v0, int v1)
+{
+    Quadric q (quadrics[v0]);
+    q.add (quadrics[v1]);
+
+    const double* p0 = &pos[3 * v0];
+    const double* p1 = &pos[3 * v1];
+    Collapse c;
+    c.v0 = v0, c.v1 = v1, c.stamp = version[v0] + version[v1];
+
+    // Optimal position, unless undefined or far off the edge; else the best
+    // of both ends and the middle
+    double edge2 = 0, off2 = 0;
+    bool found = q.minimum (c.p);
+    if (found)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            double mid = (p0[k] + p1[k]) / 2;
+            edge2 += (p1[k] - p0[k]) * (p1[k] - p0[k]);
+            off2 += (c.p[k] - mid) * (c.p[k] - mid);
+        }
+        found = (off2 <= edge2);
+    }
+    if (found)
+        c.cost = q.error (c.p);
+    else
+    {
+        double mid[3] = {(p0[0] + p1[0]) / 2, (p0[1] + p1[1]) / 2, (p0[2] + p1[2]) / 2};
+        const double* candidates[3] = {p0, p1, mid};
+        c.cost = -1;
+        for (int i = 0; i < 3; ++i)
+        {
+            double e = q.error (candidates[i]);
+            if (c.cost < 0 || e < c.cost)
+            {
+                c.cost = e;
+                for (int k = 0; k < 3; ++k)
+                    c.p[k] = candidates[i][k];
+            }
+        }
+    }
+    heap.push (c);
+}
+
+// Vertices sharing a live face with v, sorted, without duplicates
+void Decimator::neighbours (int v, std::vector<int>& n) const
+{
+    const std::vector<int>& vf = vertexFaces[v];
+    n.clear ();
+    for (size_t i = 0; i < vf.size (); ++i)
+    {
+        if (deadFace[vf[i]])
+            continue;
+        const int* t = &faces[3 * vf[i]];
+        for (int k = 0; k < 3; ++k)
+            if (t[k] != v)
+                n.push_back (t[k]);
+    }
+    std::sort (n.begin (), n.end ());
+    n.erase (std::unique (n.begin (), n.end ()), n.end ());
+}
+
+// Link condition: whether the neighbourhoods of v0 and v1 share only the
+// opposite vertices of the faces on their edge (two, or one on a border),
+// and the edge is not that of a tetrahedron. Collapsing an edge that fails
+// it pinches the mesh or folds faces onto each other
+bool Decimator::linked (int v0, int v1) const
+{
+    int edgeFaces = 0;
+    const std::vector<int>& vf = vertexFaces[v0];
+    for (size_t i = 0; i < vf.size (); ++i)
+    {
+        const int* t = &faces[3 * vf[i]];
+        if (! deadFace[vf[i]] && (t[0] == v1 || t[1] == v1 || t[2] == v1))
+            edgeFaces++;
+    }
+
+    std::vector<int> n0, n1;
+    neighbours (v0, n0);
+    neighbours (v1, n1);
+    std::vector<int> common;
+    std::set_intersection (n0.begin (), n0.end (), n1.begin (), n1.end (), std::back_inserter (common));
+    if ((int) common.size () > edgeFaces)
+        return false;
+    return edgeFaces < 2 || n0.size () + n1.size () - common.size () > 4;
+}
+
+// Whether moving v to p turns over or flattens a face it keeps (faces that
+// are already flat cannot get worse)
+bool Decimator::flips (int v, int other, const double* p) const
+{
+    const std::vector<int>& vf = vertexFaces[v];
+    for (size_t i = 0; i < vf.size (); ++i)
+    {
+        const int* t = &faces[3 * vf[i]];
+        if (deadFace[vf[i]] || t[0] == other || t[1] == other || t[2] == other)
+            continue;
+        const double* q[3];
+        for (int k = 0; k < 3; ++k)
+            q[k] = &pos[3 * t[k]];
+        double n0[3], n1[3];
+        faceNormal (q[0], q[1], q[2], n0);
+        for (int k = 0; k < 3; ++k)
+            if (t[k] == v)
+                q[k] = p;
+        faceNormal (q[0], q[1], q[2], n1);
+        double d = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+        double l0 = n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2];
+        double l1 = n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2];
+        if (l0 > 0 && (l1 <= 0 || d <= minFlipCosine * sqrt (l0 * l1)))
+            return true;
+    }
+    return false;
+}
+
+void Decimator::collapse (const Collapse& c)
+{
+    int v0 = c.v0, v1 = c.v1;
+    for (int k = 0; k < 3; ++k)
+        pos[3 * v0 + k] = c.p[k];
+    quadrics[v0].add (quadrics[v1]);
+    deadVertex[v1] = 1;
+    version[v0]++;
+
+    std::vector<int>& vf0 = vertexFaces[v0];
+    std::vector<int>& vf1 = vertexFaces[v1];
+    for (size_t i = 0; i < vf1.size (); ++i)
+    {
+        int f = vf1[i];
+        if (deadFace[f])
+            continue;
+        int* t = &faces[3 * f];
+        if (t[0] == v0 || t[1] == v0 || t[2] == v0)
+        {
+            deadFace[f] = 1;
+            live--;
+            continue;
+        }
+        for (int k = 0; k < 3; ++k)
+            if (t[k] == v1)
+                t[k] = v0;
+        vf0.push_back (f);
+    }
+    std::vector<int>().swap (vf1);
+
+    size_t n = 0;
+    for (size_t i = 0; i < vf0.size (); ++i)
+        if (! deadFace[vf0[i]])
+            vf0[n++] = vf0[i];
+    vf0.resize (n);
+
+    for (size_t i = 0; i < vf0.size (); ++i)
+    {
+        const int* t = &faces[3 * vf0[i]];
+        for (int k = 0; k < 3; ++k)
+            if (t[k] != v0)
+                push (v0, t[k]);
+    }
+}
+
+void Decimator::store (DecimatedMesh& level) const
+{
+    std::vector<int> remap (deadVertex.size (), -1);
+    level.vertices.clear ();
+    level.indices.clear ();
+    level.corners.clear ();
+    level.indices.reserve (3 * live);
+    level.corners.reserve (3 * live);
+    for (size_t f = 0; f < deadFace.size (); ++f)
+    {
+        if (deadFace[f])
+            continue;
+        for (int k = 0; k < 3; ++k)
+        {
+            int v = faces[3 * f + k];
+            if (remap[v] < 0)
+            {
+                remap[v] = (int) level.vertices.size () / 3;
+                for (int j = 0; j < 3; ++j)
+                    level.vertices.push_back ((float) pos[3 * v + j]);
+            }
+            level.indices.push_back (remap[v]);
+            level.corners.push_back ((int) (3 * f + k));
+        }
+    }
+}
+
+int Decimator::run (const int* targets, int levelCnt, DecimatedMesh* levels)
+{
+    int stored = 0;
+    while (stored < levelCnt && ! heap.empty ())
+    {
+        Collapse c = heap.top ();
+        heap.pop ();
+        if (deadVertex[c.v0] || deadVertex[c.v1] || c.stamp != version[c.v0] + version[c.v1])
+            continue;
+        if (! linked (c.v0, c.v1) || flips (c.v0, c.v1, c.p) || flips (c.v1, c.v0, c.p))
+            continue;
+        collapse (c);
+        while (stored < levelCnt && live <= targets[stored])
+            store (levels[stored++]);
+    }
+    return stored;
+}
+
+int decimateMesh (const float* vertices, const int* indices, int triangleCnt,
+                  const int* targets, int levelCnt, DecimatedMesh* levels)
+{
+    Decimator decimator (vertices, indices, triangleCnt);
+    return decimator.run (targets, levelCnt, levels);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+// One simplified version of a mesh: vertex positions and triangle vertex
+// indices, and for each triangle corner the index of the original corner
+// (3 * triangle + k) whose normal and UV coordinates it keeps
+struct DecimatedMesh
+{
+    std::vector<float> vertices;
+    std::vector<int> indices;
+    std::vector<int> corners;
+
+    int triangleCount () const              { return (int) indices.size () / 3; }
+};
+
+// Simplify a mesh by quadric-error edge collapses, in one pass that stores a
+// level each time the triangle count drops to the next of the decreasing
+// targets. Returns the number of levels stored, which is less than levelCnt
+// if the mesh cannot be simplified that far
+int decimateMesh (const float* vertices, const int* indices, int triangleCnt,
+                  const int* targets, int levelCnt, DecimatedMesh* levels);
@@ -1,7 +1,9 @@
 #include <simPovRay.h>
+#include <meshDecimation.h>
 #include <simLib/simLib.h>
 #include <simMath/4X4Matrix.h>
 #include <iostream>
+#include <vector>
 #include <QFile>
 #include <QDir>
 #include <QMap>
@@ -12,21 +14,282 @@ LIBRARY simLib;
 int resolutionX, resolutionY;
 bool perspectiveOperation;
 int light_count, mesh_count;
+int shadow_light_count;
+RENDER_SETTINGS render_settings;
+RENDER_CAMERA render_camera;
+
+// Hash of all the scene but the camera: a sensor sharing scenes renders from
+// the one kept by the last of them if it sees the same world
+quint64 worldHash, retainedHash;
+bool sceneRetained = false;
+
+// View frustum in camera space, used to cull whole meshes
+struct ViewFrustum
+{
+    C3Vector pos, axisX, axisY, axisZ;
+    float nearDist, farDist;
+    float tanX, tanY;                       // perspective half-angle tangents
+    float halfX, halfY;                     // orthographic half sizes
+    float pixelScale;                       // pixels per unit, at unit distance in perspective
+
+    bool beyondClipping (const C3Vector& c, float r) const
+    {
+        float z = (c - pos) * axisZ;
+        return (z + r < nearDist || z - r > farDist);
+    }
+
+    bool outsideView (const C3Vector& c, float r) const
+    {
+        C3Vector d (c - pos);
+        float x = fabs (d * axisX), y = fabs (d * axisY), z = d * axisZ;
+        if (perspectiveOperation)
+            return (x - z * tanX > r * sqrt (1 + tanX * tanX) ||
+                    y - z * tanY > r * sqrt (1 + tanY * tanY));
+        return (x - r > halfX || y - r > halfY);
+    }
+
+    // Radius in pixels of the image of a sphere, infinite with the camera inside it
+    float projectedRadius (const C3Vector& c, float r) const
+    {
+        if (! perspectiveOperation)
+            return r * pixelScale;
+        C3Vector d (c - pos);
+        float d2 = d * d;
+        if (d2 <= r * r)
+            return HUGE_VAL;
+        return r * pixelScale / sqrt (d2 - r * r);
+    }
+} frustum;
 QString file_name (QDir::tempPath() + "/scene.pov");
 QFile scene (file_name);
 char paragraph[65535];
 
+// Meshes outside the view, hidden from the camera: they are written at the end of
+// the scene if some light casts shadows or some visible material may reflect or
+// refract, and dropped otherwise
+QByteArray hiddenMeshes;
+bool writingHidden = false;
+bool sceneReflects;
+
+// Write to the scene file what the world hash covers
+static void writeScene (const char* data, qint64 size)
+{
+    if (writingHidden)
+    {
+        hiddenMeshes.append (data, int (size));
+        return;
+    }
+    scene.write (data, size);
+    for (qint64 i = 0; i < size; ++i)
+        worldHash = (worldHash ^ (unsigned char) data[i]) * Q_UINT64_C(1099511628211);
+}
+
+static void writeScene (const QByteArray& data)
+{
+    writeScene (data.constData (), data.size ());
+}
+
+// Free the scene kept for sensors sharing it
+static void releaseScene ()
+{
+    povray_release_scene ();
+    sceneRetained = false;
+}
+
+// Meshes smaller than this are always rendered in full
+static const int minLodTriangles = 256;
+
+// Each level of detail has a quarter of the triangles of the one above, down to this
+static const int coarsestLodTriangles = 32;
+
 struct MeshObject
 {
     char* data; int size; bool used;
+    bool bounded; float center[3], radius;  // bounding sphere in mesh coordinates
+    int triangleCnt;
+    MeshObject* levels; int levelCnt;       // simplified versions, levelCnt -1 until made
 
-    MeshObject ()                           { data = 0, size = 0, used = 0; }
-    ~MeshObject ()                          { delete[] data; }
+    MeshObject ()                           { data = 0, size = 0, used = 0, bounded = 0, triangleCnt = 0, levels = 0, levelCnt = -1; }
+    ~MeshObject ()                          { delete[] data; delete[] levels; }
     char* alloc (int n)                     { data = new char[n]; return data; }
     void append (const void* src, int cnt)  { memcpy (data + size, src, cnt); size += cnt; }
+
+    void bound (const float* vertices, const int* indices, int cnt)
+    {
+        float lo[3], hi[3];
+        for (int k = 0; k < 3; ++k)
+            lo[k] = hi[k] = (cnt > 0 ? vertices[3 * indices[0] + k] : 0);
+        for (int i = 1; i < cnt; ++i)
+            for (int k = 0; k < 3; ++k)
+            {
+                float v = vertices[3 * indices[i] + k];
+                if (v < lo[k]) lo[k] = v;
+                if (v > hi[k]) hi[k] = v;
+            }
+        radius = 0;
+        for (int k = 0; k < 3; ++k)
+            center[k] = (lo[k] + hi[k]) / 2;
+        for (int i = 0; i < cnt; ++i)
+        {
+            const float* v = vertices + 3 * indices[i];
+            float d = (v[0] - center[0]) * (v[0] - center[0]) +
+                      (v[1] - center[1]) * (v[1] - center[1]) +
+                      (v[2] - center[2]) * (v[2] - center[2]);
+            if (d > radius) radius = d;
+        }
+        radius = sqrt (radius);
+        bounded = true;
+    }
+
+    // Write the mesh head as an indexed block: vertex, normal, UV and triangle
+    // counts, then the arrays and the vertex, normal and UV indices of the
+    // triangle corners (the last two only if there are normals or UVs)
+    void writeBlock (const float* vertices, int vertexCnt, const float* normals, int normalCnt,
+                     const float* uvs, int uvCnt, const int* vertexIndices,
+                     const int* normalIndices, const int* uvIndices, int triangleCnt)
+    {
+        int counts[4] = {vertexCnt, normalCnt, uvCnt, triangleCnt};
+        int indexSize = sizeof (int) * 3 * triangleCnt;
+        alloc (40 + sizeof counts + sizeof (float) * (3 * vertexCnt + 3 * normalCnt + 2 * uvCnt) +
+               indexSize * (1 + (normalCnt > 0) + (uvCnt > 0)));
+
+        append ("mesh {indexed_block {", 21);
+        append (counts, sizeof counts);
+        append (vertices, sizeof (float) * 3 * vertexCnt);
+        append (normals, sizeof (float) * 3 * normalCnt);
+        append (uvs, sizeof (float) * 2 * uvCnt);
+        append (vertexIndices, indexSize);
+        if (normalCnt > 0)
+            append (normalIndices, indexSize);
+        if (uvCnt > 0)
+            append (uvIndices, indexSize);
+        append ("}\n", 2);
+    }
+
+    // Make and write all levels of detail at once by quadric-error decimation;
+    // each corner keeps the normal and UV coordinates it had in the full mesh
+    void decimate (const float* vertices, const int* indices, const float* normals, int normalCnt,
+                   const float* uvs, int uvCnt)
+    {
+        std::vector<int> targets;
+        for (int n = triangleCnt / 4; n >= coarsestLodTriangles; n /= 4)
+            targets.push_back (n);
+        levelCnt = 0;
+        if (targets.empty ())
+            return;
+
+        std::vector<DecimatedMesh> decimated (targets.size ());
+        levelCnt = decimateMesh (vertices, indices, triangleCnt, &targets[0], (int) targets.size (), &decimated[0]);
+        levels = new MeshObject[levelCnt];
+
+        for (int i = 0; i < levelCnt; ++i)
+        {
+            const DecimatedMesh& m = decimated[i];
+            int cornerCnt = (int) m.corners.size ();
+            std::vector<float> levelNormals, levelUvs;
+            std::vector<int> corners (cornerCnt * 2);
+            int* normalIndices = &corners[0];
+            int* uvIndices = &corners[cornerCnt];
+            for (int j = 0; j < cornerCnt; ++j)
+            {
+                int c = m.corners[j];
+                normalIndices[j] = (c < normalCnt ? (int) levelNormals.size () / 3 : -1);
+                if (c < normalCnt)
+                    levelNormals.insert (levelNormals.end (), normals + 3 * c, normals + 3 * c + 3);
+                uvIndices[j] = (c < uvCnt ? (int) levelUvs.size () / 2 : -1);
+                if (c < uvCnt)
+                    levelUvs.insert (levelUvs.end (), uvs + 2 * c, uvs + 2 * c + 2);
+            }
+
+            MeshObject& level = levels[i];
+            level.triangleCnt = m.triangleCount ();
+            level.writeBlock (&m.vertices[0], (int) m.vertices.size () / 3,
+                              levelNormals.empty () ? 0 : &levelNormals[0], (int) levelNormals.size () / 3,
+                              levelUvs.empty () ? 0 : &levelUvs[0], (int) levelUvs.size () / 2,
+                              &m.indices[0], normalIndices, uvIndices, level.triangleCnt);
+        }
+    }
+
+    // The coarsest level with at least the given number of triangles
+    MeshObject& levelOfDetail (float triangles)
+    {
+        MeshObject* level = this;
+        for (int i = 0; i < levelCnt && levels[i].triangleCnt >= triangles; ++i)
+            level = &levels[i];
+        return *level;
+    }
 };
 QMap<int, MeshObject> objects;
 
+// Materials declared in the current scene, by texture definition
+QMap<QByteArray, QByteArray> textures;
+
+// Render settings of a vision sensor
+struct SensorSettings
+{
+    int quality;                            // POV-Ray quality 0..9
+    bool antialias;
+    float aaThreshold;
+    int aaDepth;
+    int traceDepth;                         // max_trace_level
+    int areaLightSamples;                   // area light grid size, 1 for point lights
+    int threads;                            // 1 renders serially, 0 uses one per processor
+    bool rasterize;                         // rasterize the first hit of meshes for primary rays
+    float lodPixels;                        // screen area per triangle meshes are simplified to, 0 for full meshes
+    float roulette;                         // weight below which reflected and refracted rays play Russian roulette, 0 for never
+    float rayBudget;                        // average rays per pixel the trace depth adapts to, 0 for no budget
+    bool shareScene;                        // keep all meshes and the parsed scene for sensors seeing the same world
+    bool keepFrame;                         // outside the regions of interest keep the last image rather than the background
+};
+
+struct SensorPreset
+{
+    const char* name;
+    SensorSettings settings;
+};
+
+static const SensorPreset presets[] =
+{
+    {"default", {9, false, 0.3f, 3, 15, 3, 1, false, 0.0f,  0.0f,  0.0f, false, false}},
+    {"draft",   {3, false, 0.3f, 3,  3, 1, 1, true,  8.0f,  0.1f,  4.0f, false, false}},
+    {"fast",    {5, false, 0.3f, 3,  5, 2, 1, true,  4.0f,  0.05f, 8.0f, false, false}},
+    {"final",   {9, true,  0.1f, 3, 15, 5, 1, false, 0.25f, 0.02f, 0.0f, false, false}}
+};
+
+// Settings by sensor handle, and those of the sensor being rendered
+QMap<int, SensorSettings> sensorSettings;
+SensorSettings current_settings;
+
+// Regions of interest by sensor handle, and those of the sensor being rendered;
+// a sensor without regions renders its whole image
+QMap<int, std::vector<RENDER_REGION> > sensorRegions;
+std::vector<RENDER_REGION> current_regions;
+int current_sensor;
+
+// Last image of the sensors keeping it outside their regions of interest
+QMap<int, std::vector<unsigned char> > lastFrames;
+
+// For each line of the last image of a sensor, the order it was finished in from 1, or 0
+// if it was not rendered; scripts can follow the lines of the image being rendered
+QMap<int, std::vector<int> > lineSequences;
+int lineSequence;
+unsigned char* renderedImage = NULL;
+
+// Set while POV-Ray renders: line callbacks run from inside the render, and any vision
+// sensor they handle would re-enter it halfway through the image, so such passes are rejected
+bool rendering = false;
+
+// Script function called with the lines finished while the image of a sensor is rendered
+struct LineCallback
+{
+    int scriptHandle;
+    std::string function;
+};
+QMap<int, LineCallback> lineCallbacks;
+
+// Name the plugin logs under
+std::string pluginName ("PovRay");
+
 
 bool strToBool(const char* str,bool defaultValue)
 {
@@ -60,8 +323,483 @@ float strToFloat(const char* str,float defaultValue)
 
 static const char* makePatternedTexture(const std::string& povRayPattern);
 
+// Whether a material may show other objects than those in view: the reflecting
+// patterns (none of them refracts), and custom pattern text, which may do anything
+static bool mayReflect(const std::string& povRayPattern)
+{
+    if ( (povRayPattern.size()==0)||(povRayPattern.compare("default")==0) )
+        return(false);
+    const char* definition=makePatternedTexture(povRayPattern);
+    return((definition==NULL)||(strstr(definition,"reflection")!=NULL));
+}
+
+// Declare the base texture of a (pattern, colour, transparency) material the first
+// time it is used in the scene and return its identifier, or an empty identifier
+// for custom pattern text, which is not necessarily a texture and stays inline
+static QByteArray declareTexture(const std::string& povRayPattern, const float* col, float tp)
+{
+    char prologue[128] = "";
+    char plain[256];
+    const char* definition;
+
+    if ( (povRayPattern.size()>0)&&(povRayPattern.compare("default")!=0) )
+    {
+        definition=makePatternedTexture(povRayPattern);
+        if (definition==NULL)
+            return QByteArray();
+        sprintf (prologue, "#declare ObjectColor = color rgbft <%f,%f,%f,1,%f>;\n",
+                 col[0], col[1], col[2], tp);
+    }
+    else
+    {
+        sprintf (plain, "texture {pigment {rgbt <%f,%f,%f,%f>}"
+                        " finish {ambient 1 diffuse 1 specular 0.5 roughness 0.01}}",
+                 col[0], col[1], col[2], tp);
+        definition=plain;
+    }
+
+    QByteArray key (prologue);
+    key += definition;
+    QMap<QByteArray, QByteArray>::const_iterator it = textures.constFind (key);
+    if (it != textures.constEnd ())
+        return it.value ();
+
+    QByteArray name ("SimTexture" + QByteArray::number (textures.size ()));
+    writeScene (prologue);
+    writeScene ("#declare " + name + " = " + definition + "\n");
+    textures.insert (key, name);
+    return name;
+}
+
+static const SensorSettings* findPreset(const char* name)
+{
+    for (size_t i=0;i<sizeof(presets)/sizeof(presets[0]);i++)
+    {
+        if (QString(name).compare(presets[i].name,Qt::CaseInsensitive)==0)
+            return(&presets[i].settings);
+    }
+    return(NULL);
+}
+
+// Settings set from Lua, or else those given by the sensor's extension strings
+static SensorSettings getSensorSettings(int sensorHandle)
+{
+    QMap<int, SensorSettings>::const_iterator it=sensorSettings.constFind(sensorHandle);
+    if (it!=sensorSettings.constEnd())
+        return(it.value());
+
+    char* rendStr=simGetExtensionString(sensorHandle,-1,"preset@povray");
+    const SensorSettings* preset=findPreset(rendStr);
+    SensorSettings settings=(preset!=NULL)?*preset:presets[0].settings;
+    simReleaseBuffer(rendStr);
+
+    rendStr=simGetExtensionString(sensorHandle,-1,"renderBackend@povray");
+    QString backend(rendStr);
+    simReleaseBuffer(rendStr);
+
+    rendStr=simGetExtensionString(sensorHandle,-1,"renderWorkers@povray");
+    if (backend.compare("fork",Qt::CaseInsensitive)==0)
+        settings.threads=strToInt(rendStr,0);
+    else if (backend.compare("serial",Qt::CaseInsensitive)==0)
+        settings.threads=1;
+    simReleaseBuffer(rendStr);
+
+    rendStr=simGetExtensionString(sensorHandle,-1,"rasterize@povray");
+    settings.rasterize=strToBool(rendStr,settings.rasterize);
+    simReleaseBuffer(rendStr);
+
+    rendStr=simGetExtensionString(sensorHandle,-1,"lodPixels@povray");
+    settings.lodPixels=std::max(0.0f,strToFloat(rendStr,settings.lodPixels));
+    simReleaseBuffer(rendStr);
+
+    rendStr=simGetExtensionString(sensorHandle,-1,"roulette@povray");
+    settings.roulette=std::max(0.0f,std::min(strToFloat(rendStr,settings.roulette),1.0f));
+    simReleaseBuffer(rendStr);
+
+    rendStr=simGetExtensionString(sensorHandle,-1,"rayBudget@povray");
+    settings.rayBudget=std::max(0.0f,strToFloat(rendStr,settings.rayBudget));
+    simReleaseBuffer(rendStr);
+
+    rendStr=simGetExtensionString(sensorHandle,-1,"shareScene@povray");
+    settings.shareScene=strToBool(rendStr,settings.shareScene);
+    simReleaseBuffer(rendStr);
+
+    rendStr=simGetExtensionString(sensorHandle,-1,"keepFrame@povray");
+    settings.keepFrame=strToBool(rendStr,settings.keepFrame);
+    simReleaseBuffer(rendStr);
+
+    return(settings);
+}
+
+// Add a region of interest given by its first pixel and size in the sensor image
+static bool addRegion(std::vector<RENDER_REGION>& regions,int x,int y,int width,int height)
+{
+    if ((x<0)||(y<0)||(width<=0)||(height<=0))
+        return(false);
+    RENDER_REGION region;
+    region.First_Column=x;
+    region.First_Line=y;
+    region.Last_Column=x+width;
+    region.Last_Line=y+height;
+    regions.push_back(region);
+    return(true);
+}
+
+// Regions of interest set from Lua, or else those given by the sensor's extension
+// string as "x y width height" for each region, separated by semicolons
+static std::vector<RENDER_REGION> getSensorRegions(int sensorHandle)
+{
+    QMap<int, std::vector<RENDER_REGION> >::const_iterator it=sensorRegions.constFind(sensorHandle);
+    if (it!=sensorRegions.constEnd())
+        return(it.value());
+
+    std::vector<RENDER_REGION> regions;
+    char* rendStr=simGetExtensionString(sensorHandle,-1,"regions@povray");
+    if (rendStr!=NULL)
+    {
+        const char* p=rendStr;
+        int x,y,width,height,n;
+        while (sscanf(p,"%d %d %d %d%n",&x,&y,&width,&height,&n)==4)
+        {
+            addRegion(regions,x,y,width,height);
+            p+=n;
+            while ((*p==' ')||(*p==';'))
+                p++;
+        }
+        simReleaseBuffer(rendStr);
+    }
+    return(regions);
+}
+
+static bool getSetting(const SensorSettings& settings,const std::string& s,double* value)
+{
+    if (s=="quality")
+        *value=settings.quality;
+    else if (s=="antialias")
+        *value=settings.antialias?1.0:0.0;
+    else if (s=="aaThreshold")
+        *value=settings.aaThreshold;
+    else if (s=="aaDepth")
+        *value=settings.aaDepth;
+    else if (s=="traceDepth")
+        *value=settings.traceDepth;
+    else if (s=="areaLightSamples")
+        *value=settings.areaLightSamples;
+    else if (s=="threads")
+        *value=settings.threads;
+    else if (s=="rasterize")
+        *value=settings.rasterize?1.0:0.0;
+    else if (s=="lodPixels")
+        *value=settings.lodPixels;
+    else if (s=="roulette")
+        *value=settings.roulette;
+    else if (s=="rayBudget")
+        *value=settings.rayBudget;
+    else if (s=="shareScene")
+        *value=settings.shareScene?1.0:0.0;
+    else if (s=="keepFrame")
+        *value=settings.keepFrame?1.0:0.0;
+    else
+        return(false);
+    return(true);
+}
+
+static bool setSetting(SensorSettings& settings,const std::string& s,double value)
+{
+    int v=int(value+0.5);
+    if (s=="quality")
+        settings.quality=std::max(0,std::min(v,9));
+    else if (s=="antialias")
+        settings.antialias=(value!=0.0);
+    else if (s=="aaThreshold")
+        settings.aaThreshold=std::max(0.0f,float(value));
+    else if (s=="aaDepth")
+        settings.aaDepth=std::max(1,std::min(v,9));
+    else if (s=="traceDepth")
+        settings.traceDepth=std::max(1,std::min(v,256));
+    else if (s=="areaLightSamples")
+        settings.areaLightSamples=std::max(1,v);
+    else if (s=="threads")
+        settings.threads=std::max(0,v);
+    else if (s=="rasterize")
+        settings.rasterize=(value!=0.0);
+    else if (s=="lodPixels")
+        settings.lodPixels=std::max(0.0f,float(value));
+    else if (s=="roulette")
+        settings.roulette=std::max(0.0f,std::min(float(value),1.0f));
+    else if (s=="rayBudget")
+        settings.rayBudget=std::max(0.0f,float(value));
+    else if (s=="shareScene")
+        settings.shareScene=(value!=0.0);
+    else if (s=="keepFrame")
+        settings.keepFrame=(value!=0.0);
+    else
+        return(false);
+    return(true);
+}
+
+// Read the sensor handle and optional name arguments of a Lua call
+static bool getSensorArgs(SScriptCallBack* p,const char* funcName,int argCnt,int* sensorHandle,std::string* name)
+{
+    int stack=p->stackID;
+    if (simGetStackSize(stack)<argCnt)
+    {
+        simSetLastError(funcName,"Not enough arguments.");
+        return(false);
+    }
+    simMoveStackItemToTop(stack,0);
+    if (simGetStackInt32Value(stack,sensorHandle)!=1)
+    {
+        simSetLastError(funcName,"Argument 1 is not a number.");
+        return(false);
+    }
+    simPopStackItem(stack,1);
+    if (name!=NULL)
+    {
+        simMoveStackItemToTop(stack,0);
+        int len;
+        char* str=simGetStackStringValue(stack,&len);
+        if (str==NULL)
+        {
+            simSetLastError(funcName,"Argument 2 is not a string.");
+            return(false);
+        }
+        *name=std::string(str,len);
+        simReleaseBuffer(str);
+        simPopStackItem(stack,1);
+    }
+    return(true);
+}
+
+// simPovRay.setPreset(int sensorHandle,string preset)
+#define LUA_SETPRESET_COMMAND "setPreset"
+void LUA_SETPRESET_CALLBACK(SScriptCallBack* p)
+{
+    int sensorHandle;
+    std::string name;
+    if (getSensorArgs(p,LUA_SETPRESET_COMMAND,2,&sensorHandle,&name))
+    {
+        const SensorSettings* preset=findPreset(name.c_str());
+        if (preset!=NULL)
+            sensorSettings.insert(sensorHandle,*preset);
+        else
+            simSetLastError(LUA_SETPRESET_COMMAND,"Unknown preset.");
+    }
+    simPopStackItem(p->stackID,0);
+}
+
+// simPovRay.setSetting(int sensorHandle,string name,number value)
+#define LUA_SETSETTING_COMMAND "setSetting"
+void LUA_SETSETTING_CALLBACK(SScriptCallBack* p)
+{
+    int sensorHandle;
+    std::string name;
+    double value;
+    if (getSensorArgs(p,LUA_SETSETTING_COMMAND,3,&sensorHandle,&name))
+    {
+        SensorSettings settings=getSensorSettings(sensorHandle);
+        if (simGetStackDoubleValue(p->stackID,&value)!=1)
+            simSetLastError(LUA_SETSETTING_COMMAND,"Argument 3 is not a number.");
+        else if (!setSetting(settings,name,value))
+            simSetLastError(LUA_SETSETTING_COMMAND,"Unknown setting.");
+        else
+            sensorSettings.insert(sensorHandle,settings);
+    }
+    simPopStackItem(p->stackID,0);
+}
+
+// number value=simPovRay.getSetting(int sensorHandle,string name)
+#define LUA_GETSETTING_COMMAND "getSetting"
+void LUA_GETSETTING_CALLBACK(SScriptCallBack* p)
+{
+    int sensorHandle;
+    std::string name;
+    double value;
+    bool ok=false;
+    if (getSensorArgs(p,LUA_GETSETTING_COMMAND,2,&sensorHandle,&name))
+    {
+        ok=getSetting(getSensorSettings(sensorHandle),name,&value);
+        if (!ok)
+            simSetLastError(LUA_GETSETTING_COMMAND,"Unknown setting.");
+    }
+    simPopStackItem(p->stackID,0);
+    if (ok)
+        simPushDoubleOntoStack(p->stackID,value);
+}
+
+// simPovRay.setRegions(int sensorHandle,table regions)
+// regions holds x, y, width and height in pixels for each region; an empty table renders the whole image
+#define LUA_SETREGIONS_COMMAND "setRegions"
+void LUA_SETREGIONS_CALLBACK(SScriptCallBack* p)
+{
+    int sensorHandle;
+    if (getSensorArgs(p,LUA_SETREGIONS_COMMAND,2,&sensorHandle,NULL))
+    {
+        int stack=p->stackID;
+        int size=simGetStackTableInfo(stack,0);
+        std::vector<int> values(std::max(size,0));
+        bool ok=(size==sim_stack_table_empty)||((size>0)&&(size%4==0)&&(simGetStackInt32Table(stack,&values[0],size)==1));
+        std::vector<RENDER_REGION> regions;
+        for (int i=0;ok&&(i<size);i+=4)
+            ok=addRegion(regions,values[i],values[i+1],values[i+2],values[i+3]);
+        if (ok)
+            sensorRegions.insert(sensorHandle,regions);
+        else
+            simSetLastError(LUA_SETREGIONS_COMMAND,"Argument 2 is not a table of x, y, width and height for each region.");
+    }
+    simPopStackItem(p->stackID,0);
+}
+
+// table regions=simPovRay.getRegions(int sensorHandle)
+#define LUA_GETREGIONS_COMMAND "getRegions"
+void LUA_GETREGIONS_CALLBACK(SScriptCallBack* p)
+{
+    int sensorHandle;
+    bool ok=getSensorArgs(p,LUA_GETREGIONS_COMMAND,1,&sensorHandle,NULL);
+    simPopStackItem(p->stackID,0);
+    if (ok)
+    {
+        std::vector<RENDER_REGION> regions=getSensorRegions(sensorHandle);
+        std::vector<int> values;
+        for (size_t i=0;i<regions.size();i++)
+        {
+            values.push_back(regions[i].First_Column);
+            values.push_back(regions[i].First_Line);
+            values.push_back(regions[i].Last_Column-regions[i].First_Column);
+            values.push_back(regions[i].Last_Line-regions[i].First_Line);
+        }
+        simPushInt32TableOntoStack(p->stackID,values.empty()?NULL:&values[0],int(values.size()));
+    }
+}
+
+// simPovRay.setLineCallback(int sensorHandle,string functionName)
+// functionName(sensorHandle,lines) of the calling script is called with the lines finished
+// while the image of the sensor is rendered; an empty name removes the callback. It runs from
+// inside the render: vision sensors it handles are not rendered and log an error, and the
+// callbacks cannot be changed until the image is finished
+#define LUA_SETLINECALLBACK_COMMAND "setLineCallback"
+void LUA_SETLINECALLBACK_CALLBACK(SScriptCallBack* p)
+{
+    int sensorHandle;
+    std::string name;
+    if (getSensorArgs(p,LUA_SETLINECALLBACK_COMMAND,2,&sensorHandle,&name))
+    {
+        if (rendering)
+            simSetLastError(LUA_SETLINECALLBACK_COMMAND,"Line callbacks cannot be changed while an image is rendered.");
+        else if (name.empty())
+            lineCallbacks.remove(sensorHandle);
+        else
+        {
+            LineCallback callback;
+            callback.scriptHandle=p->scriptID;
+            callback.function=name;
+            lineCallbacks.insert(sensorHandle,callback);
+        }
+    }
+    simPopStackItem(p->stackID,0);
+}
+
+// table sequence=simPovRay.getLineSequence(int sensorHandle)
+// for each line of the image being or last rendered, the order it was finished in from 1, or 0
+#define LUA_GETLINESEQUENCE_COMMAND "getLineSequence"
+void LUA_GETLINESEQUENCE_CALLBACK(SScriptCallBack* p)
+{
+    int sensorHandle;
+    bool ok=getSensorArgs(p,LUA_GETLINESEQUENCE_COMMAND,1,&sensorHandle,NULL);
+    simPopStackItem(p->stackID,0);
+    if (ok)
+    {
+        std::vector<int> sequence=lineSequences.value(sensorHandle);
+        simPushInt32TableOntoStack(p->stackID,sequence.empty()?NULL:&sequence[0],int(sequence.size()));
+    }
+}
+
+// string pixels=simPovRay.getLines(int sensorHandle,int firstLine,int lineCount)
+// RGB values of lines of the image being rendered, finished or not
+#define LUA_GETLINES_COMMAND "getLines"
+void LUA_GETLINES_CALLBACK(SScriptCallBack* p)
+{
+    int sensorHandle,firstLine=0,lineCount=0;
+    int stack=p->stackID;
+    bool ok=getSensorArgs(p,LUA_GETLINES_COMMAND,3,&sensorHandle,NULL);
+    if (ok)
+    {
+        simMoveStackItemToTop(stack,0);
+        ok=(simGetStackInt32Value(stack,&firstLine)==1);
+        simPopStackItem(stack,1);
+        ok=ok&&(simGetStackInt32Value(stack,&lineCount)==1);
+        if (!ok)
+            simSetLastError(LUA_GETLINES_COMMAND,"Arguments 2 and 3 are not numbers.");
+        else if ((renderedImage==NULL)||(sensorHandle!=current_sensor))
+        {
+            simSetLastError(LUA_GETLINES_COMMAND,"The image of the sensor is not being rendered.");
+            ok=false;
+        }
+        else if ((firstLine<0)||(lineCount<0)||(firstLine+lineCount>resolutionY))
+        {
+            simSetLastError(LUA_GETLINES_COMMAND,"Invalid lines.");
+            ok=false;
+        }
+    }
+    simPopStackItem(stack,0);
+    if (ok)
+        simPushStringOntoStack(stack,(const char*)renderedImage+size_t(firstLine)*resolutionX*3,lineCount*resolutionX*3);
+}
+
+// Number the lines of a part of the image as it is finished, and pass them to the script
+// following the sensor
+static void renderProgress(void*,const RENDER_REGION* finished)
+{
+    std::vector<int>& sequence=lineSequences[current_sensor];
+    std::vector<int> lines;
+    for (int y=finished->First_Line;y<finished->Last_Line;y++)
+    {
+        sequence[y]=++lineSequence;
+        lines.push_back(y);
+    }
+
+    QMap<int, LineCallback>::const_iterator it=lineCallbacks.constFind(current_sensor);
+    if ((it==lineCallbacks.constEnd())||lines.empty())
+        return;
+
+    int stack=simCreateStack();
+    simPushInt32OntoStack(stack,current_sensor);
+    simPushInt32TableOntoStack(stack,&lines[0],int(lines.size()));
+    if (simCallScriptFunctionEx(it.value().scriptHandle,it.value().function.c_str(),stack)==-1)
+    {
+        simAddLog(pluginName.c_str(),sim_verbosity_warnings,("could not call line callback "+it.value().function+", removing it").c_str());
+        lineCallbacks.remove(current_sensor);
+    }
+    simReleaseStack(stack);
+}
+
+// Log how deep the rays of the last render went, for tuning the roulette and the ray budget
+static void logRenderStatistics()
+{
+    RENDER_STATISTICS statistics;
+    povray_render_statistics(&statistics);
+    if (statistics.Pixels<=0)
+        return;
+
+    char buffer[256];
+    snprintf(buffer,sizeof(buffer),"%ld rays, %.2f per pixel; roulette ended %ld, continued %ld; lowest trace depth %d; rays by depth:",
+             statistics.Rays,double(statistics.Rays)/double(statistics.Pixels),
+             statistics.Roulette_Terminated,statistics.Roulette_Survived,statistics.Lowest_Depth_Limit);
+    std::string message(buffer);
+    int last=RENDER_DEPTH_BINS-1;
+    while ((last>0)&&(statistics.Rays_At_Depth[last]==0))
+        last--;
+    for (int i=0;i<=last;i++)
+    {
+        snprintf(buffer,sizeof(buffer)," %ld",statistics.Rays_At_Depth[i]);
+        message+=buffer;
+    }
+    simAddLog(pluginName.c_str(),sim_verbosity_debug,message.c_str());
+}
+
 SIM_DLLEXPORT int simInit(SSimInit* info)
 {
+     pluginName=info->pluginName;
      simLib=loadSimLibrary(info->coppeliaSimLibPath);
      if (simLib==NULL)
      {
@@ -76,21 +814,48 @@ SIM_DLLEXPORT int simInit(SSimInit* info)
      }
      // ******************************************
 
+    // Register the Lua functions of the plugin:
+    simRegisterScriptCallbackFunction(LUA_SETPRESET_COMMAND,NULL,LUA_SETPRESET_CALLBACK);
+    simRegisterScriptCallbackFunction(LUA_SETSETTING_COMMAND,NULL,LUA_SETSETTING_CALLBACK);
+    simRegisterScriptCallbackFunction(LUA_GETSETTING_COMMAND,NULL,LUA_GETSETTING_CALLBACK);
+    simRegisterScriptCallbackFunction(LUA_SETREGIONS_COMMAND,NULL,LUA_SETREGIONS_CALLBACK);
+    simRegisterScriptCallbackFunction(LUA_GETREGIONS_COMMAND,NULL,LUA_GETREGIONS_CALLBACK);
+    simRegisterScriptCallbackFunction(LUA_SETLINECALLBACK_COMMAND,NULL,LUA_SETLINECALLBACK_CALLBACK);
+    simRegisterScriptCallbackFunction(LUA_GETLINESEQUENCE_COMMAND,NULL,LUA_GETLINESEQUENCE_CALLBACK);
+    simRegisterScriptCallbackFunction(LUA_GETLINES_COMMAND,NULL,LUA_GETLINES_CALLBACK);
 
     return(3);  // initialization went fine, return the version number of this plugin!
 }
 
 SIM_DLLEXPORT void simCleanup()
 {
+    releaseScene ();
     unloadSimLibrary(simLib); // release the library
 }
 
-SIM_DLLEXPORT void simMsg(SSimMsg*)
+SIM_DLLEXPORT void simMsg(SSimMsg* info)
 {
+    // A scene kept for sensors sharing it, and their last images, are of no more use
+    if (info->msgId==sim_message_eventcallback_simulationended)
+    {
+        releaseScene();
+        lastFrames.clear();
+    }
 }
 
 SIM_DLLEXPORT void simPovRay(int message,void* data)
 {
+    // A vision sensor handled from a line callback would render over the image being rendered
+    if (rendering)
+    {
+        if (message==sim_message_eventcallback_extrenderer_start)
+            simAddLog(pluginName.c_str(),sim_verbosity_errors,"vision sensors cannot be rendered from a line callback, while another image is rendered");
+        if ((message==sim_message_eventcallback_extrenderer_start)||(message==sim_message_eventcallback_extrenderer_light)||
+            (message==sim_message_eventcallback_extrenderer_mesh)||(message==sim_message_eventcallback_extrenderer_triangles)||
+            (message==sim_message_eventcallback_extrenderer_stop))
+            return;
+    }
+
     if (message==sim_message_eventcallback_extrenderer_start)
     {
         // Collect camera and environment data from CoppeliaSim:
@@ -125,6 +890,25 @@ SIM_DLLEXPORT void simPovRay(int message,void* data)
         int povBlurSamples=strToInt(rendStr,10);
         simReleaseBuffer(rendStr);
 
+        current_settings=getSensorSettings(objectHandle);
+        povray_init_settings(&render_settings);
+        render_settings.Backend=(current_settings.threads==1)?RENDER_BACKEND_SERIAL:RENDER_BACKEND_FORK;
+        render_settings.Workers=current_settings.threads;
+        render_settings.Quality=current_settings.quality;
+        render_settings.Antialias=current_settings.antialias;
+        render_settings.Antialias_Threshold=current_settings.aaThreshold;
+        render_settings.Antialias_Depth=current_settings.aaDepth;
+        render_settings.Rasterize=current_settings.rasterize;
+        render_settings.Roulette_Weight=current_settings.roulette;
+        render_settings.Ray_Budget=current_settings.rayBudget;
+
+        current_sensor=objectHandle;
+        current_regions=getSensorRegions(objectHandle);
+        render_settings.Number_Of_Regions=int(current_regions.size());
+        render_settings.Regions=current_regions.empty()?NULL:&current_regions[0];
+        render_settings.Region_Fill=RENDER_FILL_BACKGROUND;
+        render_settings.Progress_Callback=renderProgress;
+
         rendStr=simGetExtensionString(-1,-1,"fogDist@povray");
         float fogDistance=strToFloat(rendStr,4.0f);
         simReleaseBuffer(rendStr);
@@ -144,7 +928,11 @@ SIM_DLLEXPORT void simPovRay(int message,void* data)
 
         // Open output file
         scene.open (QIODevice::WriteOnly);
-        light_count = mesh_count = 0;
+        light_count = mesh_count = shadow_light_count = 0;
+        textures.clear();
+        hiddenMeshes.clear();
+        sceneReflects = false;
+        worldHash = Q_UINT64_C(14695981039346656037);
 
         // Camera transform
         C4X4Matrix m4(cameraTranformation.getMatrix());
@@ -156,9 +944,25 @@ SIM_DLLEXPORT void simPovRay(int message,void* data)
         char* p = paragraph;
 
         p += sprintf (p, "global_settings {ambient_light rgb <%f,%f,%f> "
-                         "max_trace_level 15}\nbackground {rgb <%f,%f,%f>}\ncamera {",
-                      amb[0], amb[1], amb[2],
+                         "max_trace_level %d}\nbackground {rgb <%f,%f,%f>}\n",
+                      amb[0], amb[1], amb[2], current_settings.traceDepth,
                       backgroundColor[0], backgroundColor[1], backgroundColor[2]);
+        writeScene (paragraph, p - paragraph);
+
+        // The camera is left out of the world hash, and also kept to render
+        // a shared scene from
+        p = paragraph;
+        p += sprintf (p, "camera {");
+        memset (&render_camera, 0, sizeof render_camera);
+        render_camera.Orthographic = ! perspectiveOperation;
+        render_camera.Near_Distance = nearClippingPlane;
+        render_camera.Far_Distance = farClippingPlane;
+        for (int i = 0; i < 3; ++i)
+        {
+            render_camera.Location[i] = pos(i);
+            render_camera.Sky[i] = -sky(i);
+            render_camera.Look_At[i] = foc(i);
+        }
 
         // Set camera options according to projection type
         if (perspectiveOperation)
@@ -171,14 +975,24 @@ SIM_DLLEXPORT void simPovRay(int message,void* data)
                 fx = fld * ratio, fy = fld;
 
             p += sprintf (p, "perspective location <%f,%f,%f> direction <%f,%f,%f>"
-                             " right <%f,0,0> up <0,%f,0> sky <%f,%f,%f> look_at <%f,%f,%f>",
+                             " right <%f,0,0> up <0,%f,0> sky <%f,%f,%f> look_at <%f,%f,%f>"
+                             " near_distance %f far_distance %f",
                           pos(0), pos(1), pos(2), pos(0), pos(1), pos(2),
-                          fx, fy, -sky(0), -sky(1), -sky(2), foc(0), foc(1), foc(2));
+                          fx, fy, -sky(0), -sky(1), -sky(2), foc(0), foc(1), foc(2),
+                          nearClippingPlane, farClippingPlane);
+            for (int i = 0; i < 3; ++i)
+                render_camera.Direction[i] = pos(i);
+            render_camera.Right[0] = fx;
+            render_camera.Up[1] = fy;
             if (povFocalBlurEnabled)
             {
                 C3Vector  focD(pos + dir*povFocalDistance);
                 p += sprintf (p, " focal_point <%f,%f,%f> aperture %f blur_samples %i}\n",
                               focD(0),focD(1),focD(2),povAperture,povBlurSamples);
+                for (int i = 0; i < 3; ++i)
+                    render_camera.Focal_Point[i] = focD(i);
+                render_camera.Aperture = povAperture;
+                render_camera.Blur_Samples = povBlurSamples;
             }
             else
                 p += sprintf (p, "}\n");
@@ -192,11 +1006,19 @@ SIM_DLLEXPORT void simPovRay(int message,void* data)
                 fx = orthoViewSize * ratio, fy = orthoViewSize;
 
             p += sprintf (p, "orthographic location <%f,%f,%f>"
-                             " right x * %f up y * %f sky <%f,%f,%f> look_at <%f,%f,%f>}\n",
+                             " right x * %f up y * %f sky <%f,%f,%f> look_at <%f,%f,%f>"
+                             " near_distance %f far_distance %f}\n",
                           pos(0), pos(1), pos(2),
-                          fx, fy, -sky(0), -sky(1), -sky(2), foc(0), foc(1), foc(2));
+                          fx, fy, -sky(0), -sky(1), -sky(2), foc(0), foc(1), foc(2),
+                          nearClippingPlane, farClippingPlane);
+            render_camera.Direction[2] = 1;
+            render_camera.Right[0] = fx;
+            render_camera.Up[1] = fy;
         }
 
+        writeScene (paragraph, p - paragraph);
+        p = paragraph;
+
         // Set fog parameters
         if (fogEnabled)
         {
@@ -205,17 +1027,27 @@ SIM_DLLEXPORT void simPovRay(int message,void* data)
                           fogBackgroundColor[1], fogBackgroundColor[2], fogTransp);
         }
 
-        // Set scene boundaries in camera view direction
-        C3Vector hyp (-pos(0), -pos(1), -pos(2));
-        double f1 = hyp.getLength ();
-        double f2 = f1 * dir.getLength ();
-        double f3 = (f2 > 0.0 ? f1 * (hyp * dir) / f2 : f1);
-        p += sprintf (p, "#declare NearPlane = plane {<%f,%f,%f>, %f};\n"
-                         "#declare FarPlane = plane {<%f,%f,%f>, %f};\n",
-                      -dir(0), -dir(1), -dir(2), f3 - nearClippingPlane,
-                      dir(0), dir(1), dir(2), farClippingPlane - f3);
-
-        scene.write (paragraph, p - paragraph);
+        writeScene (paragraph, p - paragraph);
+
+        // Set view frustum for mesh culling (near/far clipping is done by the camera)
+        frustum.pos = pos;
+        frustum.axisX = m4.M.axis[0];
+        frustum.axisY = m4.M.axis[1];
+        frustum.axisZ = dir;
+        frustum.nearDist = nearClippingPlane;
+        frustum.farDist = farClippingPlane;
+        if (resolutionX > resolutionY)
+            frustum.tanX = tan (viewAngle / 2), frustum.tanY = frustum.tanX / ratio;
+        else
+            frustum.tanY = tan (viewAngle / 2), frustum.tanX = frustum.tanY * ratio;
+        if (resolutionX > resolutionY)
+            frustum.halfX = orthoViewSize / 2, frustum.halfY = orthoViewSize / ratio / 2;
+        else
+            frustum.halfX = orthoViewSize * ratio / 2, frustum.halfY = orthoViewSize / 2;
+        if (perspectiveOperation)
+            frustum.pixelScale = std::max (resolutionX, resolutionY) / (2 * tan (viewAngle / 2));
+        else
+            frustum.pixelScale = std::max (resolutionX, resolutionY) / orthoViewSize;
 
         // Initialize object pool usage
         QMap<int, MeshObject>::iterator it;
@@ -269,8 +1101,12 @@ SIM_DLLEXPORT void simPovRay(int message,void* data)
         // Assign surface and draw a white disc to signal it
         if (lightSize > 0 && lightType != sim_light_directional)
         {
-            p += sprintf (p, " area_light <%f,0,0>, <0,%f,0>, 3, 3 adaptive 1 circular orient jitter",
-                          lightSize, lightSize);
+            int n = current_settings.areaLightSamples;
+            if (n > 1)
+            {
+                p += sprintf (p, " area_light <%f,0,0>, <0,%f,0>, %d, %d adaptive 1 circular orient jitter",
+                              lightSize, lightSize, n, n);
+            }
 
             if (lightIsVisible)
             {
@@ -308,9 +1144,11 @@ SIM_DLLEXPORT void simPovRay(int message,void* data)
 
         p += sprintf (p, "}\n");
 
-        scene.write (paragraph, p - paragraph);
+        writeScene (paragraph, p - paragraph);
 
         light_count++;
+        if (! noShadow)
+            shadow_light_count++;
     }
 
     else if (message==sim_message_eventcallback_extrenderer_mesh)
@@ -371,73 +1209,102 @@ SIM_DLLEXPORT void simPovRay(int message,void* data)
         MeshObject& obj = objects[meshId];
         obj.used = true;
 
-        if (! obj.data && obj.alloc (triangleCnt * 200))
+        // Cull meshes outside the view: beyond near/far they are dropped altogether;
+        // beside the frustum they are hidden from the camera, and kept only if they
+        // may be seen in shadows or reflections. A shared scene keeps all of them,
+        // as other sensors may see them
+        if (! obj.bounded)
+            obj.bound (vertices, indices, triangleCnt * 3);
+
+        C3Vector center (tr * C3Vector (obj.center));
+        bool offscreen = false;
+        if (! current_settings.shareScene)
         {
-            obj.append ("mesh {", 6);
-            for (int i = 0, vrt = 0; i < triangleCnt; ++i)
+            if (frustum.beyondClipping (center, obj.radius))
+                return;
+
+            offscreen = frustum.outsideView (center, obj.radius);
+        }
+        if (! offscreen)
+            sceneReflects = sceneReflects || mayReflect (povRayPattern);
+
+        // Declare the base texture ahead of the object
+        float tp = (translucid ? 1.0f - opacityFactor : 0.0f);
+        bool patterned = (povRayPattern.size()>0)&&(povRayPattern.compare("default")!=0);
+        QByteArray texture = declareTexture (povRayPattern, povCol, tp);
+
+        // Normals and UV coordinates are given per triangle corner, and only
+        // for as many leading triangles as there are
+        int cornerCnt = triangleCnt * 3;
+        int normalCnt = std::min (normalsCnt, cornerCnt) / 3 * 3;
+        int uvCnt = (textured ? std::min (texCoordCnt, cornerCnt) / 3 * 3 : 0);
+        obj.triangleCnt = triangleCnt;
+
+        // Pick the level of detail from the area the mesh covers in the image;
+        // simplified levels are made the first time one is needed. A shared
+        // scene must not depend on the camera, so it keeps the full meshes
+        MeshObject* level = &obj;
+        if (! current_settings.shareScene && current_settings.lodPixels > 0 && triangleCnt >= minLodTriangles)
+        {
+            float r = frustum.projectedRadius (center, obj.radius);
+            float triangles = 3.14159265f * r * r / current_settings.lodPixels;
+            if (triangles < triangleCnt)
             {
-                if (vrt < normalsCnt)
-                {
-                    obj.append ("smooth_triangle {", 17);
-                    for (int j = 3; j > 0; --j, ++vrt)
-                    {
-                        obj.append (vertices + 3 * indices[vrt], sizeof (float) * 3);
-                        obj.append (normals + 3 * vrt, sizeof (float) * 3);
-                    }
-                }
-                else
-                {
-                    obj.append ("triangle {", 10);
-                    for (int j = 3; j > 0; --j, ++vrt)
-                        obj.append (vertices + 3 * indices[vrt], sizeof (float) * 3);
-                }
-
-                if (textured && i * 3 < texCoordCnt)
-                {
-                    obj.append (" uv_vectors ", 12);
-                    obj.append (texCoords + 6 * i, sizeof (float) * 6);
-                }
-
-                obj.append ("}\n", 2);
+                if (obj.levelCnt < 0)
+                    obj.decimate (vertices, indices, normals, normalCnt, texCoords, uvCnt);
+                level = &obj.levelOfDetail (triangles);
             }
         }
 
-        scene.write (obj.data, obj.size);
+        if (! level->data)
+        {
+            int vertexCnt = 0;
+            for (int i = 0; i < cornerCnt; ++i)
+                if (indices[i] >= vertexCnt)
+                    vertexCnt = indices[i] + 1;
+
+            std::vector<int> corners (cornerCnt * 2);
+            int* normalIndices = &corners[0];
+            int* uvIndices = &corners[cornerCnt];
+            for (int i = 0; i < cornerCnt; ++i)
+            {
+                normalIndices[i] = (i < normalCnt ? i : -1);
+                uvIndices[i] = (i < uvCnt ? i : -1);
+            }
+
+            obj.writeBlock (vertices, vertexCnt, normals, normalCnt, texCoords, uvCnt,
+                            indices, normalIndices, uvIndices, triangleCnt);
+        }
+
+        writingHidden = offscreen;
+        writeScene (level->data, level->size);
 
         // Object transform
         C4X4Matrix m4(tr.getMatrix());
-        float tp = (translucid ? 1.0f - opacityFactor : 0.0f);
-        const char* str;
         char* p = paragraph;
 
-        // Build base texture
-        if ( (povRayPattern.size()>0)&&(povRayPattern.compare("default")!=0) )
-        {
-            str=makePatternedTexture(povRayPattern);
-            if (str==NULL)
-                str=povRayPattern.c_str();
+        // Build base texture: patterns must follow the object and go before its
+        // transform (the parser then copies the shared texture), as does a base
+        // under a bitmap; a plain colour is shared as is after the transform
+        bool shared = (! texture.isEmpty () && ! patterned && ! textured);
+        if (texture.isEmpty ())
             p += sprintf (p, "#declare ObjectColor = color rgbft <%f,%f,%f,1,%f>;\n%s",
-                          povCol[0], povCol[1], povCol[2], tp, str);
-        }
-        else
-        {
-            p += sprintf (p, "texture {pigment {rgbt <%f,%f,%f,%f>}"
-                             " finish {ambient 1 diffuse 1 specular 0.5 roughness 0.01}}",
-                          povCol[0], povCol[1], povCol[2], tp);
-        }
+                          povCol[0], povCol[1], povCol[2], tp, povRayPattern.c_str());
+        else if (! shared)
+            p += sprintf (p, " texture {%s}", texture.constData ());
 
         // Build bitmap texture
         if (textured)
         {
             p += sprintf (p, " texture {uv_mapping pigment {image_map {sys ");
-            scene.write (paragraph, p - paragraph);
+            writeScene (paragraph, p - paragraph);
             p = paragraph;
 
             char b[4];
             b[0] = (textureSizeX >> 8) & 0xFF; b[1] = textureSizeX & 0xFF;
             b[2] = (textureSizeY >> 8) & 0xFF; b[3] = textureSizeY & 0xFF;
-            scene.write (b, 4);
-            scene.write (textureBuff, textureSizeX * textureSizeY * 4);
+            writeScene (b, 4);
+            writeScene (textureBuff, textureSizeX * textureSizeY * 4);
 
             p += sprintf (p, " %s}} finish {ambient rgb <%f,%f,%f>"
                              " diffuse 1 specular 0.5 roughness 0.01}}",
@@ -451,9 +1318,16 @@ SIM_DLLEXPORT void simPovRay(int message,void* data)
                       m4.M.axis[2].data[0], m4.M.axis[2].data[1], m4.M.axis[2].data[2],
                       m4.X.data[0], m4.X.data[1], m4.X.data[2]);
 
-        p += sprintf (p, " clipped_by {plane {NearPlane}} clipped_by {plane {FarPlane}}}\n");
+        if (shared)
+            p += sprintf (p, " texture {%s}", texture.constData ());
 
-        scene.write (paragraph, p - paragraph);
+        if (offscreen)
+            p += sprintf (p, " no_image");
+
+        p += sprintf (p, "}\n");
+
+        writeScene (paragraph, p - paragraph);
+        writingHidden = false;
 
         mesh_count++;
     }
@@ -476,43 +1350,34 @@ SIM_DLLEXPORT void simPovRay(int message,void* data)
 
         int triangleCnt = verticesCnt / 3;
         float tp = (translucid ? 1.0f - opacityFactor : 0.0f);
-        const char* str;
         char* p = paragraph;
 
-        // Write object vertices
-        scene.write ("mesh {", 6);
-        for (int i = 0, vrt = 0; i < triangleCnt; ++i)
-        {
-            scene.write ("smooth_triangle {", 17);
-            for (int j = 3; j > 0; --j, ++vrt)
-            {
-                scene.write ((char*) (vertices + 3 * vrt), sizeof (float) * 3);
-                scene.write ((char*) (normals + 3 * i), sizeof (float) * 3);
-            }
+        // Declare the base texture ahead of the object
+        QByteArray texture = declareTexture (povRayPattern, colors, tp);
+        sceneReflects = sceneReflects || mayReflect (povRayPattern);
 
-            scene.write ("}\n", 2);
-        }
+        // Write object vertices, with one normal per triangle
+        std::vector<int> corners (triangleCnt * 6);
+        int* vertexIndices = &corners[0];
+        int* normalIndices = &corners[triangleCnt * 3];
+        for (int i = 0; i < triangleCnt * 3; ++i)
+            vertexIndices[i] = i, normalIndices[i] = i / 3;
+
+        MeshObject mesh;
+        mesh.writeBlock (vertices, triangleCnt * 3, normals, triangleCnt, 0, 0,
+                         vertexIndices, normalIndices, 0, triangleCnt);
+        writeScene (mesh.data, mesh.size);
 
         // Build base texture
-        if ( (povRayPattern.size()>0)&&(povRayPattern.compare("default")!=0) )
-        {
-            str=makePatternedTexture(povRayPattern);
-            if (str==NULL)
-                str=povRayPattern.c_str();
+        if (texture.isEmpty ())
             p += sprintf (p, "#declare ObjectColor = color rgbft <%f,%f,%f,1,%f>;\n%s",
-                          colors[0], colors[1], colors[2], tp, str);
-        }
+                          colors[0], colors[1], colors[2], tp, povRayPattern.c_str());
         else
-        {
-            p += sprintf (p, "texture {pigment {rgbt <%f,%f,%f,%f>}"
-                             " finish {ambient 1 diffuse 1 specular 0.5 roughness 0.01}}",
-                          colors[0], colors[1], colors[2], tp);
-        }
+            p += sprintf (p, " texture {%s}", texture.constData ());
 
-        // Add object modifiers
-        p += sprintf (p, " clipped_by {plane {NearPlane}} clipped_by {plane {FarPlane}}}\n");
+        p += sprintf (p, "}\n");
 
-        scene.write (paragraph, p - paragraph);
+        writeScene (paragraph, p - paragraph);
     }
 
     else if (message==sim_message_eventcallback_extrenderer_stop)
@@ -522,11 +1387,47 @@ SIM_DLLEXPORT void simPovRay(int message,void* data)
         unsigned char* rgbBuffer=(unsigned char*)valPtr[0];
         //float* depthBuffer=(float*)valPtr[1];
 
-        // Close output file
+        // Add the hidden meshes if anything may show them, and close output file
+        if (shadow_light_count > 0 || sceneReflects)
+            writeScene (hiddenMeshes);
+        hiddenMeshes.clear();
         scene.close();
 
-        // Call POV-Ray to render scene
-        povray_render_scene (file_name.toLatin1(), rgbBuffer, resolutionX, resolutionY, 0);
+        // Outside its regions of interest, a sensor keeping its last image shows it
+        size_t imageSize=size_t(resolutionX)*size_t(resolutionY)*3;
+        bool keepFrame=current_settings.keepFrame&&!current_regions.empty();
+        if (keepFrame)
+        {
+            const std::vector<unsigned char>& frame=lastFrames[current_sensor];
+            if (frame.size()==imageSize)
+            {
+                memcpy(rgbBuffer,&frame[0],imageSize);
+                render_settings.Region_Fill=RENDER_FILL_KEEP;
+            }
+        }
+
+        // Number the lines as they are finished
+        lineSequences[current_sensor].assign(resolutionY,0);
+        lineSequence=0;
+        renderedImage=rgbBuffer;
+        rendering=true;
+
+        // Call POV-Ray to render scene, or the scene kept by the last sensor
+        // sharing it from this camera if the world is the same
+        render_settings.Retain_Scene = current_settings.shareScene;
+        if (! current_settings.shareScene || ! sceneRetained || worldHash != retainedHash ||
+            ! povray_render_view (&render_camera, rgbBuffer, resolutionX, resolutionY, &render_settings))
+        {
+            povray_render_scene (file_name.toLatin1(), rgbBuffer, resolutionX, resolutionY, &render_settings);
+            sceneRetained = current_settings.shareScene;
+            retainedHash = worldHash;
+        }
+        rendering=false;
+        renderedImage=NULL;
+        logRenderStatistics ();
+
+        if (keepFrame)
+            lastFrames[current_sensor].assign(rgbBuffer,rgbBuffer+imageSize);
 
         // Check object usage
         QMap<int, MeshObject>::iterator it;